@@ -1,8 +1,12 @@
 #include "ArgsProcessing.h"
 
+#include <algorithm>
+#include <cctype>
 #include <filesystem>
 #include <iostream>
 
+#include "HuffmanCodec.h"
+
 void ArgumentsProcessing::ShowHelp(bool full = true) {
     if (full) {
         std::cout << "archiver -c archive_name file1 [file2 ...]" << std::endl
@@ -17,6 +21,30 @@ void ArgumentsProcessing::ShowHelp(bool full = true) {
                      "\tthe files should be in the same directory as the archiver"
                   << std::endl
                   << std::endl
+                  << ""
+                     ""
+                     "options (can be given after -c or -d)"
+                  << std::endl
+                  << std::endl
+                  << ""
+                     "\t--async-io             read and write files with io_uring (a thread pool if it is not available)"
+                  << std::endl
+                  << ""
+                     "\t--block-size=N         compress files in blocks of N KiB with their own codes in parallel,"
+                  << std::endl
+                  << ""
+                     "\t                       from 64 to 262144, 1024 by default, 0 for one code of the whole file"
+                  << std::endl
+                  << ""
+                     "\t--legacy-format        write the archive in the old MSB-first format without the file sizes"
+                  << std::endl
+                  << ""
+                     "\t--max-code-length=N    limit Huffman codes to N bits, from 9 to 64, 11 by default"
+                  << std::endl
+                  << ""
+                     "\t--threads=N            compress or extract the files and the blocks on N threads, all the cores"
+                  << std::endl
+                  << std::endl
                   << ""
                      ""
                      "archiver -d archive_name"
@@ -53,36 +81,45 @@ ArgumentsProcessing::ArgumentsProcessing(int argc, char* argv[]) {
         return;
     }
     std::string opt = std::string(argv[1]);
+    std::vector<std::string> args;  // the arguments after the first one, without options
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (!arg.starts_with("--")) {
+            args.emplace_back(arg);
+        } else if (!ParseOption(arg)) {
+            return;
+        }
+    }
     if (opt == "-h") {
         parsing_result = ParsingResult::Help;
     } else if (opt == "-d") {
-        if (argc == 2) {
+        if (args.empty()) {
             parsing_result = ParsingResult::Error;
             error_message = "Error: No archive name given to decode";
             return;
-        } else if (argc > 3) {
+        } else if (args.size() > 1) {
             parsing_result = ParsingResult::Error;
             error_message = "Error: Too many arguments given";
             return;
         }
 
         parsing_result = ParsingResult::Decode;
-        archive_name = argv[2];
+        archive_name = args[0];
         if (!CheckFile(archive_name)) {
             return;
         }
     } else if (opt == "-c") {
-        if (argc <= 3) {
+        if (args.size() < 2) {
             parsing_result = ParsingResult::Error;
             error_message = "Error: Not enough arguments passed";
             return;
         }
 
         parsing_result = ParsingResult::Encode;
-        archive_name = argv[2];
+        archive_name = args[0];
 
-        for (int i = 3; i < argc; ++i) {
-            files.emplace_back(argv[i]);
+        for (size_t i = 1; i < args.size(); ++i) {
+            files.emplace_back(args[i]);
         }
 
         if (!CheckFiles()) {
@@ -99,6 +136,55 @@ ArgumentsProcessing::ArgumentsProcessing() {
     ShowHelp();
 }
 
+bool ArgumentsProcessing::ParseOption(const std::string& option) {
+    if (option == "--async-io") {
+        async_io = true;
+        return true;
+    }
+    if (option == "--legacy-format") {
+        legacy_format = true;
+        return true;
+    }
+    const std::string max_code_length_option = "--max-code-length=";
+    if (option.starts_with(max_code_length_option)) {
+        return ParseNumber(option, option.substr(max_code_length_option.size()), max_code_length);
+    }
+    const std::string block_size_option = "--block-size=";
+    if (option.starts_with(block_size_option)) {
+        if (!ParseNumber(option, option.substr(block_size_option.size()), block_size)) {
+            return false;
+        }
+        // checked in KiB, so that the size in bytes can not overflow
+        if (*block_size != 0 &&
+            (*block_size < Huffman::MIN_BLOCK_SIZE / 1024 || *block_size > Huffman::MAX_BLOCK_SIZE / 1024)) {
+            parsing_result = ParsingResult::Error;
+            error_message = "Error: Incorrect value of option " + option;
+            return false;
+        }
+        return true;
+    }
+    const std::string threads_option = "--threads=";
+    if (option.starts_with(threads_option)) {
+        return ParseNumber(option, option.substr(threads_option.size()), threads);
+    }
+    parsing_result = ParsingResult::Error;
+    error_message = "Error: Unknown option " + option;
+    return false;
+}
+
+bool ArgumentsProcessing::ParseNumber(const std::string& option, const std::string& value,
+                                      std::optional<size_t>& number) {
+    const size_t max_digits = 9;
+    if (!value.empty() && value.size() <= max_digits &&
+        std::ranges::all_of(value, [](unsigned char c) { return std::isdigit(c); })) {
+        number = std::stoul(value);
+        return true;
+    }
+    parsing_result = ParsingResult::Error;
+    error_message = "Error: Incorrect value of option " + option;
+    return false;
+}
+
 bool ArgumentsProcessing::CheckFiles() {
     return std::ranges::all_of(files, [&](const std::string& file) { return CheckFile(file); });
 }
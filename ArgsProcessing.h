@@ -1,5 +1,6 @@
 #pragma once
 
+#include <optional>
 #include <string>
 #include <vector>
 
@@ -12,6 +13,8 @@ public:
     ArgumentsProcessing();
 
 private:
+    bool ParseOption(const std::string& option);
+    bool ParseNumber(const std::string& option, const std::string& value, std::optional<size_t>& number);
     bool CheckFiles();
     bool CheckFile(const std::string& file_name);
 
@@ -20,4 +23,9 @@ public:
     std::string archive_name;
     std::string error_message;
     ParsingResult parsing_result;
+    bool async_io = false;
+    bool legacy_format = false;
+    std::optional<size_t> max_code_length;
+    std::optional<size_t> block_size;  // in KiB
+    std::optional<size_t> threads;
 };
@@ -0,0 +1,419 @@
+#include "AsyncIO.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+const size_t ASYNC_BUFFER_SIZE = 1 << 22;
+const size_t ASYNC_BUFFERS = 4;
+const size_t ASYNC_IO_THREADS = 4;
+
+namespace {
+int64_t TransferAll(const AsyncIoBackend::Request& request, size_t done) {  // completes a short read or write
+    while (done < request.size) {
+        ssize_t res = request.write ? pwrite(request.fd, request.buffer + done, request.size - done,
+                                             static_cast<off_t>(request.offset + done))
+                                    : pread(request.fd, request.buffer + done, request.size - done,
+                                            static_cast<off_t>(request.offset + done));
+        if (res < 0 && errno == EINTR) {
+            continue;
+        }
+        if (res < 0) {
+            return -errno;
+        }
+        if (res == 0) {
+            break;
+        }
+        done += res;
+    }
+    return static_cast<int64_t>(done);
+}
+
+int64_t Finish(const AsyncIoBackend::Request& request, int64_t result) {
+    if (result < 0 || static_cast<size_t>(result) == request.size) {
+        return result;
+    }
+    return TransferAll(request, result);
+}
+}  // namespace
+
+AsyncIoBackend::AsyncIoBackend(size_t queue_depth) : queue_depth_(queue_depth) {
+}
+
+void AsyncIoBackend::Submit(const Request& request) {
+    while (in_flight_ >= queue_depth_) {
+        ReapOne();
+    }
+    Start(request);
+    ++in_flight_;
+}
+
+int64_t AsyncIoBackend::Wait(uint64_t tag) {
+    auto it = finished_.find(tag);
+    while (it == finished_.end()) {
+        ReapOne();
+        it = finished_.find(tag);
+    }
+    int64_t result = it->second;
+    finished_.erase(it);
+    return result;
+}
+
+size_t AsyncIoBackend::QueueDepth() const {
+    return queue_depth_;
+}
+
+void AsyncIoBackend::ReapOne() {
+    if (in_flight_ == 0) {
+        throw std::runtime_error("Error: waiting for an I/O request which was not submitted");
+    }
+    auto completion = Reap();
+    --in_flight_;
+    finished_[completion.tag] = completion.result;
+}
+
+UringBackend::UringBackend(size_t queue_depth) : AsyncIoBackend(queue_depth) {
+    io_uring_params params{};
+    ring_fd_ = static_cast<int>(syscall(__NR_io_uring_setup, static_cast<unsigned>(queue_depth), &params));
+    if (ring_fd_ < 0) {
+        throw std::runtime_error("Error: io_uring is not available");
+    }
+    if (!(params.features & IORING_FEAT_RW_CUR_POS)) {  // IORING_OP_READ and IORING_OP_WRITE came with it
+        close(ring_fd_);
+        throw std::runtime_error("Error: io_uring is too old");
+    }
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    }
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_,
+                    IORING_OFF_SQ_RING);
+    cq_ring_ = (params.features & IORING_FEAT_SINGLE_MMAP)
+                   ? sq_ring_
+                   : mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_,
+                          IORING_OFF_CQ_RING);
+    sqes_ = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+    if (sq_ring_ == MAP_FAILED || cq_ring_ == MAP_FAILED || sqes_ == MAP_FAILED) {
+        if (sqes_ != MAP_FAILED) {
+            munmap(sqes_, sqes_size_);
+        }
+        if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_) {
+            munmap(cq_ring_, cq_ring_size_);
+        }
+        if (sq_ring_ != MAP_FAILED) {
+            munmap(sq_ring_, sq_ring_size_);
+        }
+        close(ring_fd_);
+        throw std::runtime_error("Error: failed to map io_uring rings");
+    }
+    auto* sq = static_cast<char*>(sq_ring_);
+    auto* cq = static_cast<char*>(cq_ring_);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask_ = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask_ = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = cq + params.cq_off.cqes;
+}
+
+void UringBackend::Start(const Request& request) {
+    unsigned tail = *sq_tail_;
+    unsigned index = tail & *sq_mask_;
+    auto* sqe = static_cast<io_uring_sqe*>(sqes_) + index;
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = request.write ? IORING_OP_WRITE : IORING_OP_READ;
+    sqe->fd = request.fd;
+    sqe->addr = reinterpret_cast<uint64_t>(request.buffer);
+    sqe->len = static_cast<uint32_t>(request.size);
+    sqe->off = request.offset;
+    sqe->user_data = request.tag;
+    sq_array_[index] = index;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    while (syscall(__NR_io_uring_enter, ring_fd_, 1, 0, 0, nullptr, 0) < 0) {
+        if (errno != EINTR && errno != EAGAIN) {
+            throw std::runtime_error("Error: failed to submit an io_uring request");
+        }
+    }
+}
+
+UringBackend::Completion UringBackend::Reap() {
+    while (true) {
+        unsigned head = *cq_head_;
+        if (head != __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+            auto* cqe = static_cast<io_uring_cqe*>(cqes_) + (head & *cq_mask_);
+            Completion completion{cqe->user_data, cqe->res};
+            __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+            return completion;
+        }
+        if (syscall(__NR_io_uring_enter, ring_fd_, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR) {
+            throw std::runtime_error("Error: failed to wait for an io_uring completion");
+        }
+    }
+}
+
+UringBackend::~UringBackend() {
+    munmap(sqes_, sqes_size_);
+    if (cq_ring_ != sq_ring_) {
+        munmap(cq_ring_, cq_ring_size_);
+    }
+    munmap(sq_ring_, sq_ring_size_);
+    close(ring_fd_);
+}
+
+ThreadPoolBackend::ThreadPoolBackend(size_t queue_depth, size_t threads) : AsyncIoBackend(queue_depth) {
+    for (size_t i = 0; i < threads; ++i) {
+        workers_.emplace_back([this] { Work(); });
+    }
+}
+
+void ThreadPoolBackend::Start(const Request& request) {
+    {
+        std::lock_guard lock(mutex_);
+        requests_.emplace_back(request);
+    }
+    requests_cv_.notify_one();
+}
+
+ThreadPoolBackend::Completion ThreadPoolBackend::Reap() {
+    std::unique_lock lock(mutex_);
+    completions_cv_.wait(lock, [this] { return !completions_.empty(); });
+    auto completion = completions_.front();
+    completions_.pop_front();
+    return completion;
+}
+
+void ThreadPoolBackend::Work() {
+    while (true) {
+        Request request{};
+        {
+            std::unique_lock lock(mutex_);
+            requests_cv_.wait(lock, [this] { return stopped_ || !requests_.empty(); });
+            if (requests_.empty()) {
+                return;
+            }
+            request = requests_.front();
+            requests_.pop_front();
+        }
+        int64_t result = TransferAll(request, 0);
+        {
+            std::lock_guard lock(mutex_);
+            completions_.push_back({request.tag, result});
+        }
+        completions_cv_.notify_one();
+    }
+}
+
+ThreadPoolBackend::~ThreadPoolBackend() {
+    {
+        std::lock_guard lock(mutex_);
+        stopped_ = true;
+    }
+    requests_cv_.notify_all();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+std::unique_ptr<AsyncIoBackend> CreateAsyncIoBackend(size_t queue_depth) {
+    try {
+        return std::make_unique<UringBackend>(queue_depth);
+    } catch (std::runtime_error&) {
+        return std::make_unique<ThreadPoolBackend>(queue_depth, ASYNC_IO_THREADS);
+    }
+}
+
+AsyncFileSource::AsyncFileSource(int fd, size_t file_size, std::shared_ptr<AsyncIoBackend> backend)
+    : fd_(fd), file_size_(file_size), backend_(std::move(backend)), buffers_(ASYNC_BUFFERS) {
+    for (auto& buffer : buffers_) {
+        buffer.data.resize(ASYNC_BUFFER_SIZE);
+    }
+    Rewind();
+}
+
+void AsyncFileSource::SubmitNext(size_t buffer_index) {
+    auto& buffer = buffers_[buffer_index];
+    buffer.offset = next_offset_;
+    buffer.size = std::min(ASYNC_BUFFER_SIZE, file_size_ - next_offset_);
+    if (buffer.size == 0) {
+        return;
+    }
+    next_offset_ += buffer.size;
+    backend_->Submit({false, fd_, buffer.data.data(), buffer.size, buffer.offset, reinterpret_cast<uint64_t>(&buffer)});
+    buffer.in_flight = true;
+}
+
+void AsyncFileSource::Wait(size_t buffer_index) {
+    auto& buffer = buffers_[buffer_index];
+    if (!buffer.in_flight) {
+        return;
+    }
+    buffer.in_flight = false;
+    AsyncIoBackend::Request request{false, fd_, buffer.data.data(), buffer.size, buffer.offset, 0};
+    int64_t result = Finish(request, backend_->Wait(reinterpret_cast<uint64_t>(&buffer)));
+    if (result < 0) {
+        throw std::runtime_error("Error: failed to read the input file");
+    }
+    buffer.size = result;  // the file may have been truncated since it was opened
+}
+
+void AsyncFileSource::WaitAll() {
+    for (size_t i = 0; i < buffers_.size(); ++i) {
+        Wait(i);
+    }
+}
+
+std::span<const char> AsyncFileSource::Next() {
+    if (returned_) {  // the previous chunk is not used anymore, the buffer is reused for the next read
+        SubmitNext(current_);
+        current_ = (current_ + 1) % buffers_.size();
+        returned_ = false;
+    }
+    Wait(current_);
+    auto& buffer = buffers_[current_];
+    if (buffer.size == 0) {
+        return {};
+    }
+    returned_ = true;
+    return {buffer.data.data(), buffer.size};
+}
+
+bool AsyncFileSource::Rewind() {
+    WaitAll();
+    next_offset_ = 0;
+    current_ = 0;
+    returned_ = false;
+    for (size_t i = 0; i < buffers_.size(); ++i) {
+        SubmitNext(i);
+    }
+    return true;
+}
+
+void AsyncFileSource::Close() {
+    if (fd_ != -1) {
+        WaitAll();
+        close(fd_);
+        fd_ = -1;
+    }
+}
+
+AsyncFileSource::~AsyncFileSource() {
+    try {
+        Close();
+    } catch (std::runtime_error&) {
+    }
+}
+
+AsyncFileSink::AsyncFileSink(int fd, std::shared_ptr<AsyncIoBackend> backend)
+    : fd_(fd), backend_(std::move(backend)), buffers_(ASYNC_BUFFERS) {
+    for (auto& buffer : buffers_) {
+        buffer.data.resize(ASYNC_BUFFER_SIZE);
+    }
+}
+
+void AsyncFileSink::SubmitCurrent() {
+    auto& buffer = buffers_[current_];
+    if (buffer.size == 0) {
+        return;
+    }
+    backend_->Submit({true, fd_, buffer.data.data(), buffer.size, offset_, reinterpret_cast<uint64_t>(&buffer)});
+    buffer.in_flight = true;
+    buffer.offset = offset_;
+    offset_ += buffer.size;
+    current_ = (current_ + 1) % buffers_.size();
+    Wait(current_);
+    buffers_[current_].size = 0;
+}
+
+void AsyncFileSink::Wait(size_t buffer_index) {
+    auto& buffer = buffers_[buffer_index];
+    if (!buffer.in_flight) {
+        return;
+    }
+    buffer.in_flight = false;
+    AsyncIoBackend::Request request{true, fd_, buffer.data.data(), buffer.size, buffer.offset, 0};
+    int64_t result = Finish(request, backend_->Wait(reinterpret_cast<uint64_t>(&buffer)));
+    if (result < 0 || static_cast<size_t>(result) != buffer.size) {
+        throw std::runtime_error("Error: failed to write the output file");
+    }
+}
+
+void AsyncFileSink::WaitAll() {
+    for (size_t i = 0; i < buffers_.size(); ++i) {
+        Wait(i);
+    }
+}
+
+std::span<char> AsyncFileSink::GetBuffer(size_t min_size) {
+    if (min_size > ASYNC_BUFFER_SIZE) {
+        throw std::runtime_error("Error: the requested output buffer is too large");
+    }
+    if (ASYNC_BUFFER_SIZE - buffers_[current_].size < min_size) {
+        SubmitCurrent();
+    }
+    auto& buffer = buffers_[current_];
+    return {buffer.data.data() + buffer.size, ASYNC_BUFFER_SIZE - buffer.size};
+}
+
+void AsyncFileSink::Commit(size_t size) {
+    buffers_[current_].size += size;
+    if (buffers_[current_].size == ASYNC_BUFFER_SIZE) {
+        SubmitCurrent();
+    }
+}
+
+void AsyncFileSink::Preallocate(size_t size) {
+    fallocate(fd_, FALLOC_FL_KEEP_SIZE, static_cast<off_t>(offset_ + buffers_[current_].size), static_cast<off_t>(size));
+}
+
+void AsyncFileSink::Close() {
+    if (fd_ != -1) {
+        SubmitCurrent();
+        WaitAll();
+        close(fd_);
+        fd_ = -1;
+    }
+}
+
+AsyncFileSink::~AsyncFileSink() {
+    try {
+        Close();
+    } catch (std::runtime_error&) {
+    }
+}
+
+std::unique_ptr<ByteSource> OpenAsyncFileSource(const std::string& file_name,
+                                                std::shared_ptr<AsyncIoBackend> backend) {
+    int fd = open(file_name.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        throw std::runtime_error("Error: unable to open file " + file_name);
+    }
+    struct stat file_stat {};
+    if (fstat(fd, &file_stat) != 0 || !S_ISREG(file_stat.st_mode)) {
+        close(fd);
+        return OpenFileSource(file_name);
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    return std::make_unique<AsyncFileSource>(fd, static_cast<size_t>(file_stat.st_size), std::move(backend));
+}
+
+std::unique_ptr<ByteSink> CreateAsyncFileSink(const std::string& file_name, std::shared_ptr<AsyncIoBackend> backend) {
+    int fd = open(file_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        throw std::runtime_error("Error: unable to create file " + file_name);
+    }
+    struct stat file_stat {};
+    if (fstat(fd, &file_stat) != 0 || !S_ISREG(file_stat.st_mode)) {  // positioned writes need a regular file
+        return std::make_unique<FileSink>(fd);
+    }
+    return std::make_unique<AsyncFileSink>(fd, std::move(backend));
+}
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "ByteSink.h"
+#include "ByteSource.h"
+
+// Positioned reads and writes which complete in the background, one backend is used by one thread at a time
+class AsyncIoBackend {
+public:
+    struct Request {
+        bool write;
+        int fd;
+        char* buffer;
+        size_t size;
+        uint64_t offset;
+        uint64_t tag;  // unique among the requests in flight
+    };
+
+    void Submit(const Request& request);
+    int64_t Wait(uint64_t tag);  // transferred bytes or -errno
+    [[nodiscard]] size_t QueueDepth() const;
+    virtual ~AsyncIoBackend() = default;
+
+protected:
+    struct Completion {
+        uint64_t tag;
+        int64_t result;
+    };
+
+    explicit AsyncIoBackend(size_t queue_depth);
+    virtual void Start(const Request& request) = 0;
+    virtual Completion Reap() = 0;  // blocks until any request completes
+
+private:
+    void ReapOne();
+
+    size_t queue_depth_;
+    size_t in_flight_ = 0;
+    std::unordered_map<uint64_t, int64_t> finished_;  // completions nobody waited for yet
+};
+
+class UringBackend : public AsyncIoBackend {
+public:
+    explicit UringBackend(size_t queue_depth);  // throws if io_uring is not available
+    ~UringBackend() override;
+
+protected:
+    void Start(const Request& request) override;
+    Completion Reap() override;
+
+private:
+    int ring_fd_ = -1;
+    void* sq_ring_ = nullptr;
+    void* cq_ring_ = nullptr;
+    void* sqes_ = nullptr;
+    size_t sq_ring_size_ = 0;
+    size_t cq_ring_size_ = 0;
+    size_t sqes_size_ = 0;
+    unsigned* sq_tail_ = nullptr;
+    unsigned* sq_mask_ = nullptr;
+    unsigned* sq_array_ = nullptr;
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned* cq_mask_ = nullptr;
+    void* cqes_ = nullptr;
+};
+
+class ThreadPoolBackend : public AsyncIoBackend {  // pread/pwrite on worker threads
+public:
+    ThreadPoolBackend(size_t queue_depth, size_t threads);
+    ~ThreadPoolBackend() override;
+
+protected:
+    void Start(const Request& request) override;
+    Completion Reap() override;
+
+private:
+    void Work();
+
+    std::mutex mutex_;
+    std::condition_variable requests_cv_;
+    std::condition_variable completions_cv_;
+    std::deque<Request> requests_;
+    std::deque<Completion> completions_;
+    bool stopped_ = false;
+    std::vector<std::thread> workers_;
+};
+
+// io_uring when the kernel allows it, a thread pool otherwise
+std::unique_ptr<AsyncIoBackend> CreateAsyncIoBackend(size_t queue_depth);
+
+// Keeps several large reads in flight, a chunk stays valid until the next call of Next()
+class AsyncFileSource : public ByteSource {
+public:
+    AsyncFileSource(int fd, size_t file_size, std::shared_ptr<AsyncIoBackend> backend);
+    std::span<const char> Next() override;
+    bool Rewind() override;
+    void Close() override;
+    ~AsyncFileSource() override;
+
+private:
+    struct Buffer {
+        std::vector<char> data;
+        size_t size = 0;
+        uint64_t offset = 0;
+        bool in_flight = false;
+    };
+
+    void SubmitNext(size_t buffer_index);
+    void Wait(size_t buffer_index);
+    void WaitAll();
+
+    int fd_;
+    size_t file_size_;
+    std::shared_ptr<AsyncIoBackend> backend_;
+    std::vector<Buffer> buffers_;
+    size_t next_offset_ = 0;  // of the next read to submit
+    size_t current_ = 0;      // the buffer which is read next
+    bool returned_ = false;   // the current buffer was returned by Next() and can be reused
+};
+
+// Fills one buffer while the previous ones are being written
+class AsyncFileSink : public ByteSink {
+public:
+    AsyncFileSink(int fd, std::shared_ptr<AsyncIoBackend> backend);
+    std::span<char> GetBuffer(size_t min_size) override;
+    void Commit(size_t size) override;
+    void Preallocate(size_t size) override;  // reserves disk blocks, the file size is not changed
+    void Close() override;
+    ~AsyncFileSink() override;
+
+private:
+    struct Buffer {
+        std::vector<char> data;
+        size_t size = 0;
+        uint64_t offset = 0;
+        bool in_flight = false;
+    };
+
+    void SubmitCurrent();
+    void Wait(size_t buffer_index);
+    void WaitAll();
+
+    int fd_;
+    std::shared_ptr<AsyncIoBackend> backend_;
+    std::vector<Buffer> buffers_;
+    size_t current_ = 0;
+    uint64_t offset_ = 0;
+};
+
+// Regular files use the asynchronous backend, pipes and other files fall back to OpenFileSource
+std::unique_ptr<ByteSource> OpenAsyncFileSource(const std::string& file_name,
+                                                std::shared_ptr<AsyncIoBackend> backend);
+std::unique_ptr<ByteSink> CreateAsyncFileSink(const std::string& file_name, std::shared_ptr<AsyncIoBackend> backend);
@@ -1,86 +1,443 @@
 #include "BitIO.h"
 
+#include <algorithm>
+#include <bit>
+#include <cstring>
 #include <fstream>
+#include <stdexcept>
 
 const size_t BITS_IN_CHAR = 8;
+const size_t BITS_IN_WORD = 64;
+const size_t MAX_PEEK_BITS = 56;
 
-BitReader::BitReader(std::ifstream& in) : in_(in) {
+namespace {
+uint64_t LowBits(uint64_t val, size_t len) {
+    return len == BITS_IN_WORD ? val : val & ((uint64_t(1) << len) - 1);
 }
 
-bool BitReader::Get() {
-    if (buff_.empty()) {
-        if (in_.peek() == EOF) {
-            throw std::runtime_error("Error: unexpected end of file");
+uint64_t LoadBigEndian(const char* src) {
+    uint64_t word = 0;
+    std::memcpy(&word, src, sizeof(word));
+    if constexpr (std::endian::native == std::endian::little) {
+        word = __builtin_bswap64(word);
+    }
+    return word;
+}
+
+uint64_t LoadLittleEndian(const char* src) {
+    uint64_t word = 0;
+    std::memcpy(&word, src, sizeof(word));
+    if constexpr (std::endian::native == std::endian::big) {
+        word = __builtin_bswap64(word);
+    }
+    return word;
+}
+
+void StoreBigEndian(char* dst, uint64_t word) {
+    if constexpr (std::endian::native == std::endian::little) {
+        word = __builtin_bswap64(word);
+    }
+    std::memcpy(dst, &word, sizeof(word));
+}
+
+void StoreLittleEndian(char* dst, uint64_t word) {
+    if constexpr (std::endian::native == std::endian::big) {
+        word = __builtin_bswap64(word);
+    }
+    std::memcpy(dst, &word, sizeof(word));
+}
+}  // namespace
+
+uint64_t ReverseBits(uint64_t val, size_t len) {
+    if (len == 0) {
+        return 0;
+    }
+    val = ((val >> 1) & 0x5555555555555555ULL) | ((val & 0x5555555555555555ULL) << 1);
+    val = ((val >> 2) & 0x3333333333333333ULL) | ((val & 0x3333333333333333ULL) << 2);
+    val = ((val >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((val & 0x0F0F0F0F0F0F0F0FULL) << 4);
+    val = __builtin_bswap64(val);
+    return val >> (BITS_IN_WORD - len);
+}
+
+BitReader::BitReader(std::ifstream& in) : BitReader(std::make_unique<StreamSource>(in)) {
+}
+
+BitReader::BitReader(std::unique_ptr<ByteSource> source, BitOrder order)
+    : owned_source_(std::move(source)), source_(*owned_source_), order_(order) {
+}
+
+BitReader::BitReader(ByteSource& source, BitOrder order) : source_(source), order_(order) {
+}
+
+void BitReader::SetBitOrder(BitOrder order) {
+    if (window_bits_ % BITS_IN_CHAR != 0) {
+        throw std::runtime_error("Error: the bit order can only be changed between bytes");
+    }
+    if (order == order_) {
+        return;
+    }
+    uint64_t window = 0;  // the loaded bytes are repacked, bits past window_bits_ are dropped
+    for (size_t byte = 0; byte < window_bits_ / BITS_IN_CHAR; ++byte) {
+        if (order == BitOrder::LsbFirst) {
+            window |= ((window_ >> (BITS_IN_WORD - BITS_IN_CHAR * (byte + 1))) & 0xFF) << (BITS_IN_CHAR * byte);
+        } else {
+            window |= ((window_ >> (BITS_IN_CHAR * byte)) & 0xFF) << (BITS_IN_WORD - BITS_IN_CHAR * (byte + 1));
         }
+    }
+    window_ = window;
+    order_ = order;
+}
 
-        char c = in_.get();
-        for (size_t i = 0; i < BITS_IN_CHAR; ++i) {
-            buff_.emplace_back(c & (1 << i));
+BitOrder BitReader::GetBitOrder() const {
+    return order_;
+}
+
+bool BitReader::NextChunk() {
+    chunk_ = source_.Next();
+    chunk_pos_ = 0;
+    return !chunk_.empty();
+}
+
+void BitReader::StitchTail() {
+    if (in_tail_ && resumable_ && static_cast<size_t>(pos_ - tail_.data()) >= resume_offset_) {
+        // the bytes left from the previous chunk are read, go back to reading the current one in place
+        pos_ = chunk_.data() + resume_chunk_pos_ + (pos_ - tail_.data() - resume_offset_);
+        end_ = chunk_.data() + chunk_.size();
+        chunk_pos_ = chunk_.size();
+        in_tail_ = false;
+        if (end_ - pos_ >= static_cast<ptrdiff_t>(sizeof(window_))) {
+            return;
+        }
+    }
+    size_t size = end_ - pos_;
+    if (size > 0) {
+        std::memmove(tail_.data(), pos_, size);
+    }
+    resumable_ = false;
+    while (size < sizeof(window_)) {
+        if (chunk_pos_ == chunk_.size() && !NextChunk()) {
+            resumable_ = false;
+            break;
         }
+        if (size == 0 && chunk_.size() - chunk_pos_ >= sizeof(window_)) {
+            pos_ = chunk_.data() + chunk_pos_;
+            end_ = chunk_.data() + chunk_.size();
+            chunk_pos_ = chunk_.size();
+            in_tail_ = false;
+            return;
+        }
+        size_t bytes = std::min(sizeof(window_), chunk_.size() - chunk_pos_);
+        std::memcpy(tail_.data() + size, chunk_.data() + chunk_pos_, bytes);
+        resumable_ = true;
+        resume_offset_ = size;
+        resume_chunk_pos_ = chunk_pos_;
+        size += bytes;
+        chunk_pos_ += bytes;
     }
-    auto bit = buff_.back();
-    buff_.pop_back();
-    return bit;
+    std::memset(tail_.data() + size, 0, tail_.size() - size);
+    pos_ = tail_.data();
+    end_ = tail_.data() + size;
+    in_tail_ = true;
+}
+
+void BitReader::Refill() {
+    if (window_bits_ > MAX_PEEK_BITS) {
+        return;
+    }
+    if (end_ - pos_ < static_cast<ptrdiff_t>(sizeof(window_))) {
+        StitchTail();
+    }
+    // the whole word is loaded, bits past window_bits_ will be loaded again to the same place on the next refill
+    if (order_ == BitOrder::LsbFirst) {
+        window_ |= LoadLittleEndian(pos_) << window_bits_;
+    } else {
+        window_ |= LoadBigEndian(pos_) >> window_bits_;
+    }
+    size_t bytes = (BITS_IN_WORD - 1 - window_bits_) / BITS_IN_CHAR;
+    if (end_ - pos_ < static_cast<ptrdiff_t>(bytes)) {  // the end of the stream, the rest of the window is zeroes
+        bytes = end_ - pos_;
+        padding_bits_ += BITS_IN_WORD - window_bits_ - bytes * BITS_IN_CHAR;
+        window_bits_ = BITS_IN_WORD - bytes * BITS_IN_CHAR;
+    }
+    pos_ += bytes;
+    window_bits_ += bytes * BITS_IN_CHAR;
+}
+
+void BitReader::Consume(size_t len) {
+    if (window_bits_ < len) {
+        Refill();
+    }
+    if (window_bits_ < padding_bits_ + len) {
+        throw std::runtime_error("Error: unexpected end of file");
+    }
+    Skip(len);
+}
+
+ReadStatus BitReader::Status() const {
+    return window_bits_ < padding_bits_ ? ReadStatus::Overrun : ReadStatus::Ok;
+}
+
+uint64_t BitReader::ReadStream(size_t len) {
+    if (len > MAX_PEEK_BITS) {
+        size_t first_len = len - BITS_IN_WORD / 2;
+        uint64_t first = ReadStream(first_len);
+        uint64_t second = ReadStream(BITS_IN_WORD / 2);
+        return order_ == BitOrder::LsbFirst ? first | (second << first_len) : (first << BITS_IN_WORD / 2) | second;
+    }
+    uint64_t bits = Peek(len);
+    Consume(len);
+    return bits;
+}
+
+uint64_t BitReader::ReadBits(size_t len) {
+    uint64_t bits = ReadStream(len);
+    return order_ == BitOrder::LsbFirst ? ReverseBits(bits, len) : bits;
+}
+
+uint64_t BitReader::Read(size_t len) {
+    uint64_t bits = ReadStream(len);
+    return order_ == BitOrder::LsbFirst ? bits : ReverseBits(bits, len);
+}
+
+void BitReader::AlignToByte() {
+    if (Status() == ReadStatus::Ok) {
+        Skip((window_bits_ - padding_bits_) % BITS_IN_CHAR);
+    }
+}
+
+void BitReader::ReadBytes(std::span<char> bytes) {
+    if (window_bits_ % BITS_IN_CHAR != 0) {
+        throw std::runtime_error("Error: bytes can only be read between whole bytes");
+    }
+    size_t pos = 0;
+    for (; pos < bytes.size() && window_bits_ > 0; ++pos) {  // the bytes already loaded to the window
+        bytes[pos] = static_cast<char>(ReadStream(BITS_IN_CHAR));
+    }
+    if (pos == bytes.size()) {
+        return;
+    }
+    window_ = 0;  // the window is empty, the bits past window_bits_ are loaded again from pos_
+    while (pos < bytes.size()) {
+        if (pos_ == end_) {
+            StitchTail();
+            if (pos_ == end_) {
+                throw std::runtime_error("Error: unexpected end of file");
+            }
+        }
+        size_t size = std::min<size_t>(bytes.size() - pos, end_ - pos_);
+        std::memcpy(bytes.data() + pos, pos_, size);
+        pos += size;
+        pos_ += size;
+    }
+}
+
+bool BitReader::Get() {
+    return ReadStream(1);
 }
 
 std::vector<bool> BitReader::Get(size_t size) {
     std::vector<bool> res;
+    res.reserve(size);
     while (res.size() < size) {
-        res.emplace_back(Get());
+        size_t len = std::min(size - res.size(), MAX_PEEK_BITS);
+        uint64_t bits = Read(len);
+        for (size_t bit = 0; bit < len; ++bit) {
+            res.emplace_back((bits >> bit) & 1);
+        }
     }
     return res;
 }
 
 void BitReader::Close() {
-    in_.close();
+    source_.Close();
 }
 
 BitReader::~BitReader() {
     Close();
 }
 
-BitWriter::BitWriter(std::ofstream& out) : out_(out) {
+BitWriter::BitWriter(std::ofstream& out) : BitWriter(std::make_unique<StreamSink>(out)) {
+}
+
+BitWriter::BitWriter(std::unique_ptr<ByteSink> sink, BitOrder order)
+    : owned_sink_(std::move(sink)), sink_(*owned_sink_), order_(order) {
+}
+
+BitWriter::BitWriter(ByteSink& sink, BitOrder order) : sink_(sink), order_(order) {
 }
 
 void BitWriter::Write(uint64_t val, size_t len) {
-    std::vector<bool> bits;
-    for (size_t i = 0; i < len; ++i) {
-        bits.emplace_back(val % 2);
-        val >>= 1;
+    if (order_ == BitOrder::MsbFirst) {
+        WriteBits(ReverseBits(val, len), len);
+        return;
+    }
+    val = LowBits(val, len);
+    if (acc_bits_ + len < BITS_IN_WORD) {
+        acc_ |= val << acc_bits_;
+        acc_bits_ += len;
+        return;
     }
-    Write(bits);
+    size_t used = BITS_IN_WORD - acc_bits_;  // bits of val which fit into the current word
+    acc_ |= val << acc_bits_;
+    FlushWord();
+    acc_ = used == BITS_IN_WORD ? 0 : val >> used;
+    acc_bits_ = len - used;
 }
 
 void BitWriter::Write(const std::vector<bool>& bits) {
+    uint64_t word = 0;
+    size_t word_bits = 0;
     for (auto bit : bits) {
-        buff_.emplace_back(bit);
-        if (buff_.size() == BITS_IN_CHAR) {
-            Write();
+        word |= uint64_t(bit) << word_bits;
+        if (++word_bits == BITS_IN_WORD) {
+            Write(word, word_bits);
+            word = 0;
+            word_bits = 0;
         }
     }
+    Write(word, word_bits);
 }
 
-void BitWriter::Write() {
-    char buff_char = 0;
-    for (size_t i = 0; i < BITS_IN_CHAR; ++i) {
-        buff_char |= buff_[i] << (BITS_IN_CHAR - i - 1);
+void BitWriter::WriteBits(uint64_t bits, size_t len) {
+    if (order_ == BitOrder::LsbFirst) {
+        Write(ReverseBits(bits, len), len);
+        return;
     }
-    out_.put(buff_char);
-    buff_.clear();
+    bits = LowBits(bits, len);
+    size_t free_bits = BITS_IN_WORD - acc_bits_;
+    if (len < free_bits) {
+        acc_ = (acc_ << len) | bits;
+        acc_bits_ += len;
+        return;
+    }
+    size_t rest = len - free_bits;  // bits which do not fit into the current word
+    acc_ = (free_bits == BITS_IN_WORD ? 0 : acc_ << free_bits) | (bits >> rest);
+    FlushWord();
+    acc_ = LowBits(bits, rest);
+    acc_bits_ = rest;
 }
 
-void BitWriter::Close() {
-    if (buff_.empty()) {
-        out_.close();
+void BitWriter::AlignToByte() {
+    Write(0, PaddingBits());
+}
+
+void BitWriter::WriteBytes(std::span<const char> bytes) {
+    if (acc_bits_ % BITS_IN_CHAR != 0) {
+        throw std::runtime_error("Error: bytes can only be written between whole bytes");
+    }
+    FlushBytes();
+    while (!bytes.empty()) {
+        EnsureBuffer(1);
+        size_t size = std::min(buffer_.size() - buffer_pos_, bytes.size());
+        std::memcpy(buffer_.data() + buffer_pos_, bytes.data(), size);
+        buffer_pos_ += size;
+        bytes = bytes.subspan(size);
+    }
+}
+
+void BitWriter::WriteStream(std::span<const char> bytes, uint64_t bits) {
+    size_t whole_bytes = bits / BITS_IN_CHAR;
+    size_t pos = 0;
+    if (acc_bits_ % BITS_IN_CHAR == 0) {
+        WriteBytes(bytes.first(whole_bytes));
+        pos = whole_bytes;
+    }
+    for (; pos + sizeof(uint64_t) <= whole_bytes; pos += sizeof(uint64_t)) {  // shifted by the current position
+        if (order_ == BitOrder::LsbFirst) {
+            Write(LoadLittleEndian(bytes.data() + pos), BITS_IN_WORD);
+        } else {
+            WriteBits(LoadBigEndian(bytes.data() + pos), BITS_IN_WORD);
+        }
+    }
+    for (; pos < whole_bytes; ++pos) {
+        if (order_ == BitOrder::LsbFirst) {
+            Write(static_cast<unsigned char>(bytes[pos]), BITS_IN_CHAR);
+        } else {
+            WriteBits(static_cast<unsigned char>(bytes[pos]), BITS_IN_CHAR);
+        }
+    }
+    size_t tail_bits = bits % BITS_IN_CHAR;
+    if (tail_bits > 0) {
+        auto tail = static_cast<unsigned char>(bytes[whole_bytes]);
+        if (order_ == BitOrder::LsbFirst) {
+            Write(tail, tail_bits);
+        } else {
+            WriteBits(tail >> (BITS_IN_CHAR - tail_bits), tail_bits);
+        }
+    }
+}
+
+size_t BitWriter::PaddingBits() const {
+    return (BITS_IN_CHAR - acc_bits_ % BITS_IN_CHAR) % BITS_IN_CHAR;
+}
+
+uint64_t BitWriter::Position() const {
+    return (committed_ + buffer_pos_) * BITS_IN_CHAR + acc_bits_;
+}
+
+void BitWriter::EnsureBuffer(size_t bytes) {
+    if (buffer_.size() - buffer_pos_ < bytes) {
+        sink_.Commit(buffer_pos_);
+        committed_ += buffer_pos_;
+        buffer_ = sink_.GetBuffer(bytes);
+        buffer_pos_ = 0;
+    }
+}
+
+void BitWriter::Preallocate(uint64_t bits) {
+    sink_.Commit(buffer_pos_);
+    committed_ += buffer_pos_;
+    buffer_ = {};
+    buffer_pos_ = 0;
+    sink_.Preallocate((acc_bits_ + bits + BITS_IN_CHAR - 1) / BITS_IN_CHAR);
+}
+
+void BitWriter::FlushWord() {
+    EnsureBuffer(sizeof(acc_));
+    if (order_ == BitOrder::LsbFirst) {
+        StoreLittleEndian(buffer_.data() + buffer_pos_, acc_);
+    } else {
+        StoreBigEndian(buffer_.data() + buffer_pos_, acc_);
+    }
+    buffer_pos_ += sizeof(acc_);
+}
+
+void BitWriter::FlushBytes() {
+    if (acc_bits_ == 0) {
         return;
     }
-    while (buff_.size() < BITS_IN_CHAR) {
-        buff_.emplace_back(0);
+    size_t bytes = acc_bits_ / BITS_IN_CHAR;
+    EnsureBuffer(bytes);
+    uint64_t tail = order_ == BitOrder::LsbFirst ? acc_ : acc_ << (BITS_IN_WORD - acc_bits_);
+    for (size_t i = 0; i < bytes; ++i) {
+        size_t shift = order_ == BitOrder::LsbFirst ? BITS_IN_CHAR * i : BITS_IN_WORD - BITS_IN_CHAR * (i + 1);
+        buffer_[buffer_pos_++] = static_cast<char>(tail >> shift);
+    }
+    acc_ = 0;
+    acc_bits_ = 0;
+}
+
+void BitWriter::Flush() {
+    AlignToByte();
+    FlushBytes();
+    sink_.Commit(buffer_pos_);
+    committed_ += buffer_pos_;
+    buffer_ = {};
+    buffer_pos_ = 0;
+}
+
+void BitWriter::Close() {
+    if (closed_) {
+        return;
     }
-    Write();
-    out_.close();
+    closed_ = true;
+    Flush();
+    sink_.Close();
 }
 
 BitWriter::~BitWriter() {
-    Close();
+    try {
+        Close();
+    } catch (std::runtime_error&) {  // call Close() explicitly to get the error
+    }
 }
@@ -1,32 +1,122 @@
 #pragma once
 
+#include <array>
 #include <bitset>
+#include <cstdint>
 #include <fstream>
+#include <memory>
+#include <span>
 #include <vector>
 
+#include "ByteSink.h"
+#include "ByteSource.h"
+
+// How the bits of the stream are packed into bytes. The bits themselves go in the same order for both:
+// BitWriter::Write(val, len) puts the least significant bit of val first, BitWriter::WriteBits(bits, len) the most
+// significant one. MsbFirst fills each byte from the highest bit, LsbFirst from the lowest one, so an LsbFirst stream
+// is read and written with plain little-endian 64-bit loads and stores.
+enum class BitOrder { MsbFirst, LsbFirst };
+
+// Overrun means more bits were skipped than the stream has, the missing ones were read as zeroes
+enum class ReadStatus { Ok, Overrun };
+
+uint64_t ReverseBits(uint64_t val, size_t len);  // reverses the lowest len bits
+
 class BitReader {
 public:
     explicit BitReader(std::ifstream& in);
+    explicit BitReader(std::unique_ptr<ByteSource> source, BitOrder order = BitOrder::MsbFirst);
+    explicit BitReader(ByteSource& source, BitOrder order = BitOrder::MsbFirst);
+    void SetBitOrder(BitOrder order);  // only between whole bytes
+    [[nodiscard]] BitOrder GetBitOrder() const;
     bool Get();
     std::vector<bool> Get(size_t size);
+    // the next len <= 56 bits, zero-padded at EOF; the first bit is the most significant one for MsbFirst and the
+    // least significant one for LsbFirst
+    uint64_t Peek(size_t len) {
+        if (window_bits_ < len) {
+            Refill();
+        }
+        if (order_ == BitOrder::LsbFirst) {
+            return window_ & ((uint64_t(1) << len) - 1);
+        }
+        return len == 0 ? 0 : window_ >> (sizeof(uint64_t) * 8 - len);
+    }
+    // skips len bits after Peek(len) or a longer one without checking the end of the stream, see Status()
+    void Skip(size_t len) {
+        if (order_ == BitOrder::LsbFirst) {
+            window_ >>= len;
+        } else {
+            window_ <<= len;
+        }
+        window_bits_ -= len;
+    }
+    void Consume(size_t len);  // skips len <= 56 bits
+    [[nodiscard]] ReadStatus Status() const;
+    uint64_t ReadBits(size_t len);  // reads len <= 64 bits written by BitWriter::WriteBits(bits, len)
+    uint64_t Read(size_t len);      // reads len <= 64 bits written by BitWriter::Write(val, len)
+    void AlignToByte();             // skips the rest of the current byte
+    void ReadBytes(std::span<char> bytes);  // only between whole bytes
     void Close();
     ~BitReader();
 
 private:
-    std::ifstream& in_;
-    std::vector<bool> buff_;  // buff is reversed (Big-endian)
+    void Refill();
+    void StitchTail();
+    bool NextChunk();
+    uint64_t ReadStream(size_t len);  // len <= 64 bits in the order of Peek()
+
+private:
+    std::unique_ptr<ByteSource> owned_source_;
+    ByteSource& source_;
+    BitOrder order_;
+    std::span<const char> chunk_;
+    size_t chunk_pos_ = 0;  // the bytes of chunk_ before it were copied to tail_ or handed over to pos_
+    // the unread bytes, there are always 8 readable bytes from pos_ on, zeroes after the end of the stream
+    const char* pos_ = nullptr;
+    const char* end_ = nullptr;
+    std::array<char, 2 * sizeof(uint64_t)> tail_{};  // the bytes around chunk boundaries and the zero padding
+    bool in_tail_ = false;
+    bool resumable_ = false;  // tail_ bytes from resume_offset_ on are the chunk_ bytes from resume_chunk_pos_ on
+    size_t resume_offset_ = 0;
+    size_t resume_chunk_pos_ = 0;
+    uint64_t window_ = 0;  // the next bits of the stream in the order of Peek(), aligned to the first bit
+    size_t window_bits_ = 0;
+    size_t padding_bits_ = 0;  // zero bits added to the window after the end of the stream
 };
 
 class BitWriter {
 public:
     explicit BitWriter(std::ofstream& out);
-    void Write(size_t val, size_t len);
+    explicit BitWriter(std::unique_ptr<ByteSink> sink, BitOrder order = BitOrder::MsbFirst);
+    explicit BitWriter(ByteSink& sink, BitOrder order = BitOrder::MsbFirst);
+    void Write(size_t val, size_t len);  // writes the lowest len <= 64 bits of val, the least significant bit first
     void Write(const std::vector<bool>& bits);
+    void WriteBits(uint64_t bits, size_t len);  // writes the lowest len <= 64 bits, the most significant bit first
+    void AlignToByte();                         // pads the current byte with zeroes
+    void WriteBytes(std::span<const char> bytes);  // only between whole bytes
+    // the first bits of the bytes written by a BitWriter of the same order, at any position
+    void WriteStream(std::span<const char> bytes, uint64_t bits);
+    [[nodiscard]] size_t PaddingBits() const;  // the zero bits which Close() adds to the last byte
+    [[nodiscard]] uint64_t Position() const;   // the number of bits written
+    void Preallocate(uint64_t bits);               // at least bits more bits will be written
+    void Flush();  // pads the current byte with zeroes and commits the bytes to the sink, the writing may go on
     void Close();
     ~BitWriter();
 
 private:
-    void Write();
-    std::vector<bool> buff_;
-    std::ofstream& out_;
-};
\ No newline at end of file
+    void EnsureBuffer(size_t bytes);
+    void FlushWord();
+    void FlushBytes();  // the whole bytes of the accumulator
+
+private:
+    std::unique_ptr<ByteSink> owned_sink_;
+    ByteSink& sink_;
+    BitOrder order_;
+    std::span<char> buffer_;  // borrowed from the sink
+    size_t buffer_pos_ = 0;
+    uint64_t committed_ = 0;  // the bytes committed to the sink
+    uint64_t acc_ = 0;  // pending bits: MsbFirst keeps the oldest one highest, LsbFirst in the lowest bit
+    size_t acc_bits_ = 0;
+    bool closed_ = false;
+};
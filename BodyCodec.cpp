@@ -0,0 +1,107 @@
+#include "BodyCodec.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "ByteHistogram.h"
+
+namespace Huffman {
+const size_t BITS_IN_BYTE = 8;
+
+void WriteCodes(std::span<const char> bytes, const CanonicalCodes& codes, BitWriter& out) {
+    for (auto c : bytes) {
+        const auto& code = codes[static_cast<unsigned char>(c)];
+        out.Write(code.bits, code.len);
+    }
+}
+
+void ReadCodeTable(BitReader& in, size_t max_code_length, std::vector<Symbol>& symbols,
+                   std::vector<size_t>& length_counts) {
+    size_t symbols_count = in.Read(BITS_IN_SYMBOL);
+    symbols.clear();
+    for (size_t i = 0; i < symbols_count; ++i) {  // get symbols in the order of canonical codes
+        symbols.emplace_back(in.Read(BITS_IN_SYMBOL));
+    }
+
+    length_counts.assign(1, 0);  // the numbers of codes of each length until all symbols have codes
+    for (size_t counted = 0; counted < symbols_count;) {
+        if (length_counts.size() > max_code_length) {
+            throw std::runtime_error("Error: Huffman code is longer than the limit of the archive");
+        }
+        length_counts.emplace_back(in.Read(BITS_IN_SYMBOL));
+        counted += length_counts.back();
+    }
+}
+
+void DecodeBytes(BitReader& in, const DecodeTable& table, size_t size, ByteSink& out) {
+    while (size > 0) {
+        auto buffer = out.GetBuffer(DecodeTable::MAX_RUN);
+        size_t end = std::min(buffer.size(), size);
+        size_t pos = 0;
+        while (end - pos >= DecodeTable::MAX_RUN) {
+            const auto& run = table.LookupRun(in);
+            if (run.count > 0) {  // all MAX_RUN bytes are copied, only count of them are kept
+                std::memcpy(buffer.data() + pos, run.bytes.data(), run.bytes.size());
+                pos += run.count;
+                in.Skip(run.len);
+            } else {
+                buffer[pos++] = static_cast<char>(table.Decode(in).to_ulong());
+            }
+        }
+        for (; pos < end; ++pos) {
+            buffer[pos] = static_cast<char>(table.Decode(in).to_ulong());
+        }
+        out.Commit(end);
+        size -= end;
+    }
+}
+
+BlockEncoder::BlockEncoder(size_t max_code_length) : max_code_length_(max_code_length) {
+}
+
+std::span<const char> BlockEncoder::Encode(std::span<const char> block) {
+    ByteHistogram histogram;
+    histogram.Add(block);
+    SymbolFreqs symbol_freq{};
+    auto byte_freq = histogram.Counts();
+    std::copy(byte_freq.begin(), byte_freq.end(), symbol_freq.begin());
+    // a code has at least one bit only if there are two symbols, so a block of one repeated byte gets a second one
+    if (std::count(symbol_freq.begin(), symbol_freq.end(), 0) == static_cast<ptrdiff_t>(SYMBOLS_AMOUNT) - 1) {
+        ++symbol_freq[symbol_freq[0] == 0 ? 0 : 1];
+    }
+    codes_.Build(symbol_freq, max_code_length_);
+
+    uint64_t max_bits = codes_.TableBits() + block.size() * codes_.MaxLength();
+    size_t capacity = max_bits / BITS_IN_BYTE + 2 * sizeof(uint64_t);
+    if (encoded_.size() < capacity) {
+        encoded_.resize(capacity);
+    }
+    MemorySink sink(encoded_);
+    BitWriter writer(sink, BitOrder::LsbFirst);
+    codes_.WriteTable(writer);
+    WriteCodes(block, codes_, writer);
+    writer.Close();
+    return std::span<const char>(encoded_).first(sink.Size());
+}
+
+BlockDecoder::BlockDecoder(size_t max_code_length) : max_code_length_(max_code_length) {
+}
+
+void BlockDecoder::Decode(std::span<const char> encoded, size_t size, ByteSink& out) {
+    MemorySource source(encoded);
+    BitReader in(source, BitOrder::LsbFirst);
+    ReadCodeTable(in, max_code_length_, symbols_, length_counts_);
+    if (symbols_.size() < 2) {
+        throw std::runtime_error("Error: The file is invalid, a block has less than two codes");
+    }
+    if (std::any_of(symbols_.begin(), symbols_.end(), [](Symbol symbol) { return (symbol >> BITS_IN_BYTE).any(); })) {
+        throw std::runtime_error("Error: The file is invalid, a block has a special symbol");
+    }
+    table_.Build(symbols_, length_counts_, BitOrder::LsbFirst);
+    DecodeBytes(in, table_, size, out);
+    if (in.Status() == ReadStatus::Overrun) {
+        throw std::runtime_error("Error: unexpected end of file");
+    }
+}
+}  // namespace Huffman
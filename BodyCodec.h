@@ -0,0 +1,48 @@
+#pragma once
+
+#include <span>
+#include <vector>
+
+#include "BitIO.h"
+#include "ByteSink.h"
+#include "ByteSource.h"
+#include "CanonicalCodes.h"
+#include "DecodeTable.h"
+
+namespace Huffman {
+// The layouts of the file bodies, see HuffmanCodec.h. A block with its own codes has its code table, then the codes of
+// its bytes packed BitOrder::LsbFirst.
+
+void WriteCodes(std::span<const char> bytes, const CanonicalCodes& codes, BitWriter& out);
+
+// the table written by CanonicalCodes::WriteTable(), length_counts[len] is the number of codes of length len
+void ReadCodeTable(BitReader& in, size_t max_code_length, std::vector<Symbol>& symbols,
+                   std::vector<size_t>& length_counts);
+// size bytes written by WriteCodes(), the table should have only byte symbols
+void DecodeBytes(BitReader& in, const DecodeTable& table, size_t size, ByteSink& out);
+
+// Encodes the blocks with their own codes of bytes, keeps the memory between the blocks
+class BlockEncoder {
+public:
+    explicit BlockEncoder(size_t max_code_length);
+    std::span<const char> Encode(std::span<const char> block);  // valid until the next call
+
+private:
+    size_t max_code_length_;
+    CanonicalCodes codes_;
+    std::vector<char> encoded_;
+};
+
+// Decodes the blocks written by BlockEncoder, keeps the memory between the blocks
+class BlockDecoder {
+public:
+    explicit BlockDecoder(size_t max_code_length);
+    void Decode(std::span<const char> encoded, size_t size, ByteSink& out);  // the block has size bytes
+
+private:
+    size_t max_code_length_;
+    std::vector<Symbol> symbols_;
+    std::vector<size_t> length_counts_;
+    DecodeTable table_;
+};
+}  // namespace Huffman
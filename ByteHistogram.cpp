@@ -0,0 +1,47 @@
+#include "ByteHistogram.h"
+
+#include <algorithm>
+#include <cstring>
+
+const size_t BITS_IN_CHAR = 8;
+const uint64_t MAX_PENDING = UINT32_MAX;  // a single table can not overflow before it
+
+void ByteHistogram::Add(std::span<const char> bytes) {
+    while (!bytes.empty()) {
+        if (pending_ == MAX_PENDING) {
+            Flush();
+        }
+        auto part = bytes.first(std::min<uint64_t>(bytes.size(), MAX_PENDING - pending_));
+        bytes = bytes.subspan(part.size());
+        pending_ += part.size();
+
+        const char* pos = part.data();
+        const char* end = pos + part.size();
+        for (; end - pos >= static_cast<ptrdiff_t>(sizeof(uint64_t)); pos += sizeof(uint64_t)) {
+            uint64_t word = 0;
+            std::memcpy(&word, pos, sizeof(word));  // the order of the bytes in the word does not matter
+            for (size_t i = 0; i < TABLES; ++i) {
+                ++tables_[i][(word >> (i * BITS_IN_CHAR)) & (BYTE_VALUES - 1)];
+            }
+        }
+        for (; pos != end; ++pos) {
+            ++tables_[0][static_cast<unsigned char>(*pos)];
+        }
+    }
+}
+
+std::array<uint64_t, ByteHistogram::BYTE_VALUES> ByteHistogram::Counts() const {
+    auto counts = counts_;
+    for (const auto& table : tables_) {
+        for (size_t byte = 0; byte < BYTE_VALUES; ++byte) {
+            counts[byte] += table[byte];
+        }
+    }
+    return counts;
+}
+
+void ByteHistogram::Flush() {
+    counts_ = Counts();
+    tables_ = {};
+    pending_ = 0;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+// Counts the bytes of a stream. Neighbouring bytes are counted in different tables, so that a run of equal bytes
+// does not make each increment wait for the store of the previous one.
+class ByteHistogram {
+public:
+    constexpr static const size_t BYTE_VALUES = 256;
+
+    void Add(std::span<const char> bytes);
+    [[nodiscard]] std::array<uint64_t, BYTE_VALUES> Counts() const;  // indexed by unsigned bytes
+
+private:
+    void Flush();  // moves the 32-bit counts to counts_ before they can overflow
+
+private:
+    constexpr static const size_t TABLES = sizeof(uint64_t);  // one for each byte of a word
+    std::array<std::array<uint32_t, BYTE_VALUES>, TABLES> tables_{};
+    std::array<uint64_t, BYTE_VALUES> counts_{};
+    uint64_t pending_ = 0;  // the bytes counted in tables_
+};
@@ -0,0 +1,282 @@
+#include "ByteSink.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <unistd.h>
+
+const size_t WRITE_BUFFER_SIZE = 1 << 20;
+const size_t PAGE_SIZE = 1 << 12;
+
+namespace {
+int CreateFile(const std::string& file_name) {
+    int fd = open(file_name.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        throw std::runtime_error("Error: unable to create file " + file_name);
+    }
+    return fd;
+}
+}  // namespace
+
+void ByteSink::Preallocate(size_t) {
+}
+
+void ByteSink::Close() {
+}
+
+StreamSink::StreamSink(std::ofstream& out) : out_(out), buffer_(WRITE_BUFFER_SIZE) {
+}
+
+std::span<char> StreamSink::GetBuffer(size_t min_size) {
+    if (buffer_.size() < min_size) {
+        buffer_.resize(min_size);
+    }
+    return buffer_;
+}
+
+void StreamSink::Commit(size_t size) {
+    out_.write(buffer_.data(), static_cast<std::streamsize>(size));
+}
+
+void StreamSink::Close() {
+    out_.close();
+}
+
+MemorySink::MemorySink(std::span<char> memory) : memory_(memory) {
+}
+
+std::span<char> MemorySink::GetBuffer(size_t min_size) {
+    if (memory_.size() - size_ < min_size) {
+        throw std::runtime_error("Error: the output buffer is too small");
+    }
+    return memory_.subspan(size_);
+}
+
+void MemorySink::Commit(size_t size) {
+    size_ += size;
+}
+
+void MemorySink::Preallocate(size_t size) {
+    if (memory_.size() - size_ < size) {
+        throw std::runtime_error("Error: the output buffer is too small");
+    }
+}
+
+size_t MemorySink::Size() const {
+    return size_;
+}
+
+std::span<char> VectorSink::GetBuffer(size_t min_size) {
+    if (data_.size() - size_ < min_size) {
+        data_.resize(std::max({size_ + min_size, data_.size() * 2, WRITE_BUFFER_SIZE}));
+    }
+    return std::span<char>(data_).subspan(size_);
+}
+
+void VectorSink::Commit(size_t size) {
+    size_ += size;
+}
+
+void VectorSink::Preallocate(size_t size) {
+    if (data_.size() - size_ < size) {
+        data_.resize(size_ + size);
+    }
+}
+
+void VectorSink::Close() {
+    data_.resize(size_);
+}
+
+const std::vector<char>& VectorSink::Data() const {
+    return data_;
+}
+
+size_t VectorSink::Size() const {
+    return size_;
+}
+
+std::vector<char> VectorSink::Release() {
+    Close();
+    size_ = 0;
+    return std::move(data_);
+}
+
+void VectorSink::Clear() {
+    size_ = 0;
+}
+
+void FileSink::FreeDeleter::operator()(char* ptr) const {
+    std::free(ptr);
+}
+
+FileSink::FileSink(int fd) : fd_(fd) {
+    void* buffer = nullptr;
+    if (posix_memalign(&buffer, PAGE_SIZE, WRITE_BUFFER_SIZE) != 0) {
+        throw std::runtime_error("Error: failed to allocate the output buffer");
+    }
+    buffer_.reset(static_cast<char*>(buffer));
+}
+
+std::span<char> FileSink::GetBuffer(size_t min_size) {
+    if (min_size > WRITE_BUFFER_SIZE) {
+        throw std::runtime_error("Error: the requested output buffer is too large");
+    }
+    if (WRITE_BUFFER_SIZE - buffer_pos_ < min_size) {
+        Flush();
+    }
+    return {buffer_.get() + buffer_pos_, WRITE_BUFFER_SIZE - buffer_pos_};
+}
+
+void FileSink::Commit(size_t size) {
+    buffer_pos_ += size;
+    if (buffer_pos_ == WRITE_BUFFER_SIZE) {
+        Flush();
+    }
+}
+
+void FileSink::Preallocate(size_t size) {
+    // not supported by pipes and some file systems, then the file simply grows on writes
+    fallocate(fd_, FALLOC_FL_KEEP_SIZE, static_cast<off_t>(offset_ + buffer_pos_), static_cast<off_t>(size));
+}
+
+void FileSink::Flush() {
+    for (size_t pos = 0; pos < buffer_pos_;) {
+        ssize_t written = write(fd_, buffer_.get() + pos, buffer_pos_ - pos);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written < 0) {
+            throw std::runtime_error("Error: failed to write the output file");
+        }
+        pos += written;
+    }
+    offset_ += buffer_pos_;
+    buffer_pos_ = 0;
+}
+
+void FileSink::Close() {
+    if (fd_ != -1) {
+        Flush();
+        close(fd_);
+        fd_ = -1;
+    }
+}
+
+FileSink::~FileSink() {
+    if (fd_ != -1) {
+        try {
+            Flush();
+        } catch (std::runtime_error&) {
+        }
+        close(fd_);
+    }
+}
+
+MappedFileSink::MappedFileSink(int fd, size_t capacity) : fd_(fd) {
+    try {
+        Resize(std::max(capacity, PAGE_SIZE));
+    } catch (std::runtime_error&) {
+        close(fd_);
+        throw;
+    }
+}
+
+void MappedFileSink::Resize(size_t capacity) {
+    // the blocks are allocated before they are mapped, so running out of space is an error here and not a SIGBUS later
+    int res = posix_fallocate(fd_, static_cast<off_t>(capacity_), static_cast<off_t>(capacity - capacity_));
+    if (res == ENOSPC || (res != 0 && ftruncate(fd_, static_cast<off_t>(capacity)) != 0)) {
+        throw std::runtime_error("Error: failed to resize the output file");
+    }
+    void* data = data_ == nullptr ? mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0)
+                                  : mremap(data_, capacity_, capacity, MREMAP_MAYMOVE);
+    if (data == MAP_FAILED) {
+        throw std::runtime_error("Error: failed to map the output file");
+    }
+    data_ = static_cast<char*>(data);
+    capacity_ = capacity;
+}
+
+std::span<char> MappedFileSink::GetBuffer(size_t min_size) {
+    if (capacity_ - size_ < min_size) {
+        Resize(std::max(size_ + min_size, capacity_ * 2));
+    }
+    return {data_ + size_, capacity_ - size_};
+}
+
+void MappedFileSink::Commit(size_t size) {
+    size_ += size;
+}
+
+void MappedFileSink::Preallocate(size_t size) {
+    if (capacity_ - size_ < size) {
+        Resize(size_ + size);
+    }
+}
+
+void MappedFileSink::Close() {
+    if (data_ != nullptr) {
+        munmap(data_, capacity_);
+        data_ = nullptr;
+    }
+    if (fd_ != -1) {
+        if (ftruncate(fd_, static_cast<off_t>(size_)) != 0) {
+            close(fd_);
+            fd_ = -1;
+            throw std::runtime_error("Error: failed to resize the output file");
+        }
+        close(fd_);
+        fd_ = -1;
+    }
+}
+
+MappedFileSink::~MappedFileSink() {
+    try {
+        Close();
+    } catch (std::runtime_error&) {
+    }
+}
+
+PositionalFile::PositionalFile(const std::string& file_name, uint64_t size) : fd_(CreateFile(file_name)) {
+    // the blocks are allocated at once when the file system supports it, otherwise the file is sparse until written
+    int res = size == 0 ? 0 : posix_fallocate(fd_, 0, static_cast<off_t>(size));
+    if (res == ENOSPC || (res != 0 && ftruncate(fd_, static_cast<off_t>(size)) != 0)) {
+        close(fd_);
+        throw std::runtime_error("Error: failed to resize the output file");
+    }
+}
+
+void PositionalFile::WriteAt(std::span<const char> bytes, uint64_t offset) {
+    while (!bytes.empty()) {
+        ssize_t written = pwrite(fd_, bytes.data(), bytes.size(), static_cast<off_t>(offset));
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            throw std::runtime_error("Error: failed to write the output file");
+        }
+        bytes = bytes.subspan(written);
+        offset += written;
+    }
+}
+
+void PositionalFile::Close() {
+    if (fd_ != -1) {
+        close(fd_);
+        fd_ = -1;
+    }
+}
+
+PositionalFile::~PositionalFile() {
+    Close();
+}
+
+std::unique_ptr<ByteSink> CreateFileSink(const std::string& file_name) {
+    return std::make_unique<FileSink>(CreateFile(file_name));
+}
+
+std::unique_ptr<ByteSink> CreateMappedFileSink(const std::string& file_name, size_t capacity) {
+    return std::make_unique<MappedFileSink>(CreateFile(file_name), capacity);
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <fstream>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+// A sink lends its own memory to the writer, so the data is not copied on the way to the destination
+class ByteSink {
+public:
+    virtual std::span<char> GetBuffer(size_t min_size) = 0;  // at least min_size writable bytes
+    virtual void Commit(size_t size) = 0;                    // the first size bytes of the last buffer are written
+    virtual void Preallocate(size_t size);  // at least size more bytes will be committed, invalidates the buffer
+    virtual void Close();
+    virtual ~ByteSink() = default;
+};
+
+class StreamSink : public ByteSink {
+public:
+    explicit StreamSink(std::ofstream& out);
+    std::span<char> GetBuffer(size_t min_size) override;
+    void Commit(size_t size) override;
+    void Close() override;
+
+private:
+    std::ofstream& out_;
+    std::vector<char> buffer_;
+};
+
+class MemorySink : public ByteSink {  // a fixed caller-owned region, overflowing it is an error
+public:
+    explicit MemorySink(std::span<char> memory);
+    std::span<char> GetBuffer(size_t min_size) override;
+    void Commit(size_t size) override;
+    void Preallocate(size_t size) override;
+    [[nodiscard]] size_t Size() const;
+
+private:
+    std::span<char> memory_;
+    size_t size_ = 0;
+};
+
+class VectorSink : public ByteSink {  // a growable in-memory buffer
+public:
+    VectorSink() = default;
+    std::span<char> GetBuffer(size_t min_size) override;
+    void Commit(size_t size) override;
+    void Preallocate(size_t size) override;
+    void Close() override;
+    [[nodiscard]] const std::vector<char>& Data() const;  // has uncommitted bytes at the end until Close()
+    [[nodiscard]] size_t Size() const;                    // of the committed bytes
+    std::vector<char> Release();
+    void Clear();  // keeps the memory
+
+private:
+    std::vector<char> data_;
+    size_t size_ = 0;
+};
+
+class FileSink : public ByteSink {  // write(2) from a large page-aligned buffer
+public:
+    explicit FileSink(int fd);
+    std::span<char> GetBuffer(size_t min_size) override;
+    void Commit(size_t size) override;
+    void Preallocate(size_t size) override;  // reserves disk blocks, the file size is not changed
+    void Close() override;
+    ~FileSink() override;
+
+private:
+    void Flush();
+
+    struct FreeDeleter {
+        void operator()(char* ptr) const;
+    };
+
+    int fd_;
+    std::unique_ptr<char[], FreeDeleter> buffer_;
+    size_t buffer_pos_ = 0;
+    uint64_t offset_ = 0;  // of the buffer in the file
+};
+
+class MappedFileSink : public ByteSink {  // writes into a shared mapping of the file, grows it when it is full
+public:
+    MappedFileSink(int fd, size_t capacity);
+    std::span<char> GetBuffer(size_t min_size) override;
+    void Commit(size_t size) override;
+    void Preallocate(size_t size) override;  // grows the mapping to the exact size
+    void Close() override;
+    ~MappedFileSink() override;
+
+private:
+    void Resize(size_t capacity);
+
+    int fd_;
+    char* data_ = nullptr;
+    size_t capacity_ = 0;
+    size_t size_ = 0;
+};
+
+// A file of a known size written at any offsets with pwrite(2), from any number of threads at once
+class PositionalFile {
+public:
+    PositionalFile(const std::string& file_name, uint64_t size);
+    void WriteAt(std::span<const char> bytes, uint64_t offset);
+    void Close();
+    ~PositionalFile();
+
+private:
+    int fd_;
+};
+
+std::unique_ptr<ByteSink> CreateFileSink(const std::string& file_name);
+std::unique_ptr<ByteSink> CreateMappedFileSink(const std::string& file_name, size_t capacity);
@@ -0,0 +1,162 @@
+#include "ByteSource.h"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const size_t READ_BUFFER_SIZE = 1 << 20;
+
+bool ByteSource::Rewind() {
+    return false;
+}
+
+bool ByteSource::InMemory() const {
+    return false;
+}
+
+void ByteSource::Close() {
+}
+
+StreamSource::StreamSource(std::ifstream& in) : in_(in), buffer_(READ_BUFFER_SIZE) {
+}
+
+std::span<const char> StreamSource::Next() {
+    in_.read(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+    return {buffer_.data(), static_cast<size_t>(in_.gcount())};
+}
+
+bool StreamSource::Rewind() {
+    in_.clear();
+    in_.seekg(0);
+    return !in_.fail();
+}
+
+void StreamSource::Close() {
+    in_.close();
+}
+
+FileSource::FileSource(int fd) : fd_(fd), buffer_(READ_BUFFER_SIZE) {
+}
+
+std::span<const char> FileSource::Next() {
+    size_t size = 0;
+    while (size < buffer_.size()) {  // pipes return partial reads, fill the buffer to keep the chunks large
+        ssize_t read_bytes = read(fd_, buffer_.data() + size, buffer_.size() - size);
+        if (read_bytes < 0 && errno == EINTR) {
+            continue;
+        }
+        if (read_bytes < 0) {
+            throw std::runtime_error("Error: failed to read the input file");
+        }
+        if (read_bytes == 0) {
+            break;
+        }
+        size += read_bytes;
+    }
+    return {buffer_.data(), size};
+}
+
+bool FileSource::Rewind() {
+    return lseek(fd_, 0, SEEK_SET) == 0;
+}
+
+void FileSource::Close() {
+    if (fd_ != -1) {
+        close(fd_);
+        fd_ = -1;
+    }
+}
+
+FileSource::~FileSource() {
+    Close();
+}
+
+MappedFileSource::MappedFileSource(int fd, size_t size, bool huge_pages) : fd_(fd), size_(size) {
+    void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+    if (data == MAP_FAILED) {
+        throw std::runtime_error("Error: failed to map the input file");
+    }
+    data_ = static_cast<char*>(data);
+    madvise(data_, size_, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+    if (huge_pages) {
+        madvise(data_, size_, MADV_HUGEPAGE);  // only a hint, file systems without huge page support ignore it
+    }
+#else
+    (void)huge_pages;
+#endif
+}
+
+std::span<const char> MappedFileSource::Next() {
+    if (consumed_) {
+        return {};
+    }
+    consumed_ = true;
+    return {data_, size_};
+}
+
+bool MappedFileSource::Rewind() {
+    consumed_ = false;
+    return true;
+}
+
+bool MappedFileSource::InMemory() const {
+    return true;  // a reread touches the pages again, they come from the disk if the page cache has evicted them
+}
+
+void MappedFileSource::Close() {
+    if (data_ != nullptr) {
+        munmap(data_, size_);
+        data_ = nullptr;
+    }
+    if (fd_ != -1) {
+        close(fd_);
+        fd_ = -1;
+    }
+}
+
+MappedFileSource::~MappedFileSource() {
+    Close();
+}
+
+MemorySource::MemorySource(std::span<const char> memory) : memory_(memory) {
+}
+
+MemorySource::MemorySource(std::vector<char> data) : data_(std::move(data)), memory_(data_) {
+}
+
+std::span<const char> MemorySource::Next() {
+    if (consumed_) {
+        return {};
+    }
+    consumed_ = true;
+    return memory_;
+}
+
+bool MemorySource::Rewind() {
+    consumed_ = false;
+    return true;
+}
+
+bool MemorySource::InMemory() const {
+    return true;
+}
+
+std::unique_ptr<ByteSource> OpenFileSource(const std::string& file_name, bool huge_pages) {
+    int fd = open(file_name.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        throw std::runtime_error("Error: unable to open file " + file_name);
+    }
+    struct stat file_stat {};
+    if (fstat(fd, &file_stat) == 0 && S_ISREG(file_stat.st_mode) && file_stat.st_size > 0) {
+        try {
+            return std::make_unique<MappedFileSource>(fd, static_cast<size_t>(file_stat.st_size), huge_pages);
+        } catch (std::runtime_error&) {  // some file systems do not support mmap
+        }
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    return std::make_unique<FileSource>(fd);
+}
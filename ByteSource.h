@@ -0,0 +1,75 @@
+#pragma once
+
+#include <fstream>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+class ByteSource {
+public:
+    virtual std::span<const char> Next() = 0;  // the next chunk of input, an empty chunk means the end of input
+    virtual bool Rewind();                     // restarts from the beginning, false if the input can not be reread
+    // the whole input is addressable as the single chunk of Next(), so copying it into a buffer saves nothing
+    [[nodiscard]] virtual bool InMemory() const;
+    virtual void Close();
+    virtual ~ByteSource() = default;
+};
+
+class StreamSource : public ByteSource {
+public:
+    explicit StreamSource(std::ifstream& in);
+    std::span<const char> Next() override;
+    bool Rewind() override;
+    void Close() override;
+
+private:
+    std::ifstream& in_;
+    std::vector<char> buffer_;
+};
+
+class FileSource : public ByteSource {  // buffered read(2), works for pipes and other non-mappable files
+public:
+    explicit FileSource(int fd);
+    std::span<const char> Next() override;
+    bool Rewind() override;
+    void Close() override;
+    ~FileSource() override;
+
+private:
+    int fd_;
+    std::vector<char> buffer_;
+};
+
+class MappedFileSource : public ByteSource {  // the whole file is returned as a single chunk
+public:
+    MappedFileSource(int fd, size_t size, bool huge_pages);
+    std::span<const char> Next() override;
+    bool Rewind() override;
+    [[nodiscard]] bool InMemory() const override;
+    void Close() override;
+    ~MappedFileSource() override;
+
+private:
+    int fd_;
+    char* data_ = nullptr;
+    size_t size_;
+    bool consumed_ = false;
+};
+
+class MemorySource : public ByteSource {  // the whole memory is returned as a single chunk
+public:
+    explicit MemorySource(std::span<const char> memory);
+    explicit MemorySource(std::vector<char> data);
+    std::span<const char> Next() override;
+    bool Rewind() override;
+    [[nodiscard]] bool InMemory() const override;
+
+private:
+    std::vector<char> data_;
+    std::span<const char> memory_;
+    bool consumed_ = false;
+};
+
+// Maps regular files into memory, other files (pipes, character devices, ...) are read with read(2)
+std::unique_ptr<ByteSource> OpenFileSource(const std::string& file_name, bool huge_pages = false);
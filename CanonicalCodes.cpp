@@ -0,0 +1,108 @@
+#include "CanonicalCodes.h"
+
+#include <algorithm>
+#include <span>
+#include <stdexcept>
+#include <tuple>
+
+#include "CodeLengths.h"
+
+namespace Huffman {
+const size_t MAX_CODE_LENGTH = 64;
+
+void CanonicalCodes::Build(const SymbolFreqs& symbol_freq, size_t max_code_length) {
+    Clear();
+    std::array<std::pair<uint64_t, uint16_t>, SYMBOLS_AMOUNT> sorted;  // frequencies with their symbols
+    size_t n = 0;
+    for (size_t symbol = 0; symbol < SYMBOLS_AMOUNT; ++symbol) {
+        if (symbol_freq[symbol] > 0) {
+            sorted[n++] = {symbol_freq[symbol], symbol};
+        }
+    }
+    if (n == 0) {
+        throw std::runtime_error("Error: Failed to get canonical codes for symbols");
+    }
+    std::sort(sorted.begin(), sorted.begin() + n);
+
+    std::array<uint64_t, SYMBOLS_AMOUNT> lengths;
+    for (size_t i = 0; i < n; ++i) {
+        lengths[i] = sorted[i].first;
+    }
+    CodeLengthsInPlace(std::span(lengths).first(n));
+    if (lengths[0] > max_code_length) {
+        // the code is too long for the limit, an optimal limited one is built instead
+        std::vector<uint64_t> freqs;
+        for (size_t i = 0; i < n; ++i) {
+            freqs.emplace_back(sorted[i].first);
+        }
+        auto limited_lengths = LimitedCodeLengths(freqs, max_code_length);
+        std::copy(limited_lengths.begin(), limited_lengths.end(), lengths.begin());
+    }
+
+    std::vector<std::pair<Symbol, size_t>> code_lengths_per_symbol;
+    for (size_t i = 0; i < n; ++i) {
+        code_lengths_per_symbol.emplace_back(sorted[i].second, lengths[i]);
+    }
+    Assign(code_lengths_per_symbol);
+}
+
+void CanonicalCodes::Assign(std::vector<std::pair<Symbol, size_t>>& code_length_per_symbol) {
+    std::sort(code_length_per_symbol.begin(), code_length_per_symbol.end(), [&](const auto& a, const auto& b) {
+        auto a_symbol = a.first.to_ullong();
+        auto b_symbol = b.first.to_ullong();
+        return std::tie(a.second, a_symbol) < std::tie(b.second, b_symbol);
+    });
+    uint64_t code = 0;
+    for (size_t i = 0; i < code_length_per_symbol.size(); ++i) {
+        size_t len = code_length_per_symbol[i].second;
+        Symbol symbol = code_length_per_symbol[i].first;
+
+        symbols_ordered_by_codes_.emplace_back(symbol);
+
+        if (len > MAX_CODE_LENGTH) {
+            throw std::runtime_error("Error: Huffman code is too long");
+        }
+        codes_[symbol.to_ullong()] = {ReverseBits(code, len), len};
+        max_length_ = std::max(max_length_, len);
+        if (i + 1 < code_length_per_symbol.size()) {
+            size_t next_len = code_length_per_symbol[i + 1].second;
+            code = (code + 1) << (next_len - len);
+        }
+    }
+}
+
+void CanonicalCodes::WriteTable(BitWriter& out) const {
+    out.Write(symbols_ordered_by_codes_.size(), BITS_IN_SYMBOL);  // SYMBOLS_COUNT, 9 bits
+
+    for (const auto& symbol : symbols_ordered_by_codes_) {  // Symbols in canonical codes order, each has 9 bits
+        out.Write(symbol.to_ullong(), BITS_IN_SYMBOL);
+    }
+
+    // the amount of symbols with each code length
+    std::array<size_t, MAX_CODE_LENGTH + 1> count_symbols_with_code_len{};
+    for (const auto& symbol : symbols_ordered_by_codes_) {
+        ++count_symbols_with_code_len[codes_[symbol.to_ullong()].len];
+    }
+    for (size_t len = 1; len <= max_length_; ++len) {
+        out.Write(count_symbols_with_code_len[len], BITS_IN_SYMBOL);
+    }
+}
+
+uint64_t CanonicalCodes::TableBits() const {
+    return BITS_IN_SYMBOL * (1 + symbols_ordered_by_codes_.size() + max_length_);
+}
+
+size_t CanonicalCodes::MaxLength() const {
+    return max_length_;
+}
+
+size_t CanonicalCodes::SymbolsCount() const {
+    return symbols_ordered_by_codes_.size();
+}
+
+void CanonicalCodes::Clear() {
+    symbols_ordered_by_codes_.clear();
+    std::fill(codes_.begin(), codes_.end(), PackedCode{});
+    max_length_ = 0;
+}
+}  // namespace Huffman
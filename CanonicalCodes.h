@@ -0,0 +1,42 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "BitIO.h"
+#include "HuffmanTree.h"
+
+namespace Huffman {
+const size_t SYMBOLS_AMOUNT = 1 << BITS_IN_SYMBOL;
+using SymbolFreqs = std::array<uint64_t, SYMBOLS_AMOUNT>;  // indexed by symbols
+
+// Canonical Huffman codes of the symbols with nonzero frequencies
+class CanonicalCodes {
+public:
+    struct PackedCode {
+        uint64_t bits = 0;  // reversed, so that BitWriter::Write(bits, len) writes the first bit of the code first
+        size_t len = 0;     // zero for the symbols without a code
+    };
+
+    void Build(const SymbolFreqs& symbol_freq, size_t max_code_length);
+    // the number of symbols, the symbols in the order of their codes and the number of codes of each length up to
+    // the longest one, BITS_IN_SYMBOL bits each
+    void WriteTable(BitWriter& out) const;
+    [[nodiscard]] uint64_t TableBits() const;
+    [[nodiscard]] size_t MaxLength() const;
+    [[nodiscard]] size_t SymbolsCount() const;
+    const PackedCode& operator[](size_t symbol) const {
+        return codes_[symbol];
+    }
+    void Clear();
+
+private:
+    void Assign(std::vector<std::pair<Symbol, size_t>>& code_length_per_symbol);
+
+private:
+    std::vector<Symbol> symbols_ordered_by_codes_;
+    std::vector<PackedCode> codes_ = std::vector<PackedCode>(SYMBOLS_AMOUNT);  // indexed by symbols
+    size_t max_length_ = 0;
+};
+}  // namespace Huffman
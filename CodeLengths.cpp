@@ -0,0 +1,190 @@
+#include "CodeLengths.h"
+
+#include <algorithm>
+#include <array>
+#include <numeric>
+#include <stdexcept>
+
+namespace Huffman {
+void CodeLengthsInPlace(std::span<uint64_t> sorted_freqs) {
+    auto& a = sorted_freqs;
+    size_t n = a.size();
+    if (n <= 1) {
+        std::fill(a.begin(), a.end(), 0);
+        return;
+    }
+    // the first pass merges the two lightest of the leaves and the internal nodes, a[next] gets the weight of the
+    // next internal node and a merged internal node gets the index of its parent
+    a[0] += a[1];
+    size_t root = 0;
+    size_t leaf = 2;
+    for (size_t next = 1; next < n - 1; ++next) {
+        if (leaf >= n || a[root] < a[leaf]) {
+            a[next] = a[root];
+            a[root++] = next;
+        } else {
+            a[next] = a[leaf++];
+        }
+        if (leaf >= n || (root < next && a[root] < a[leaf])) {
+            a[next] += a[root];
+            a[root++] = next;
+        } else {
+            a[next] += a[leaf++];
+        }
+    }
+    // the second pass turns the parent indices into the depths of the internal nodes
+    a[n - 2] = 0;
+    for (size_t next = n - 2; next-- > 0;) {
+        a[next] = a[a[next]] + 1;
+    }
+    // the third pass gives the leaves the depths of the free places on each level, the lightest ones the deepest
+    size_t available = 1;
+    size_t used = 0;
+    uint64_t depth = 0;
+    size_t internal = n - 1;  // one past the next internal node to look at
+    size_t next = n;          // one past the next leaf to set
+    while (available > 0) {
+        while (internal > 0 && a[internal - 1] == depth) {
+            ++used;
+            --internal;
+        }
+        while (available > used) {
+            a[--next] = depth;
+            --available;
+        }
+        available = 2 * used;
+        ++depth;
+        used = 0;
+    }
+}
+
+void CodeLengthsBuilder::RadixSort(std::span<const uint64_t> freqs) {
+    const size_t digit_bits = 8;
+    const size_t digits = 1 << digit_bits;
+    order_.resize(freqs.size());
+    sort_buffer_.resize(freqs.size());
+    std::iota(order_.begin(), order_.end(), 0);
+    uint64_t max_freq = freqs.empty() ? 0 : *std::max_element(freqs.begin(), freqs.end());
+    for (size_t shift = 0; shift < 64 && (max_freq >> shift) > 0; shift += digit_bits) {
+        std::array<size_t, digits + 1> starts{};  // a stable counting sort by the digit
+        for (auto freq : freqs) {
+            ++starts[((freq >> shift) & (digits - 1)) + 1];
+        }
+        std::partial_sum(starts.begin(), starts.end(), starts.begin());
+        for (auto index : order_) {
+            sort_buffer_[starts[(freqs[index] >> shift) & (digits - 1)]++] = index;
+        }
+        order_.swap(sort_buffer_);
+    }
+}
+
+std::span<const size_t> CodeLengthsBuilder::BuildCodeLengths(std::span<const uint64_t> freqs) {
+    size_t n = freqs.size();
+    lengths_.assign(n, 0);
+    if (n <= 1) {
+        return lengths_;
+    }
+    RadixSort(freqs);
+
+    weights_.resize(2 * n - 1);
+    parents_.resize(2 * n - 1);
+    for (size_t i = 0; i < n; ++i) {
+        weights_[i] = freqs[order_[i]];
+    }
+    // the merged nodes are created in non-decreasing order of weights, so both queues stay sorted, the merged queue
+    // is [merged, node)
+    size_t leaf = 0;
+    size_t merged = n;
+    for (size_t node = n; node < 2 * n - 1; ++node) {
+        auto take_lightest = [&]() {
+            if (leaf < n && (merged == node || weights_[leaf] <= weights_[merged])) {
+                return leaf++;
+            }
+            return merged++;
+        };
+        size_t first = take_lightest();
+        size_t second = take_lightest();
+        weights_[node] = weights_[first] + weights_[second];
+        parents_[first] = node;
+        parents_[second] = node;
+    }
+
+    // a child is always created before its parent, so the depths are set from the root down
+    std::vector<uint32_t>& depths = sort_buffer_;
+    depths.resize(2 * n - 1);
+    depths[2 * n - 2] = 0;
+    for (size_t node = 2 * n - 2; node-- > 0;) {
+        depths[node] = depths[parents_[node]] + 1;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        lengths_[order_[i]] = depths[i];
+    }
+    return lengths_;
+}
+
+std::vector<size_t> HeapCodeLengths(const std::vector<uint64_t>& freqs) {
+    HeapCodeLengthsBuilder<> builder;
+    auto lengths = builder.BuildCodeLengths(freqs);
+    return {lengths.begin(), lengths.end()};
+}
+
+std::vector<size_t> LimitedCodeLengths(const std::vector<uint64_t>& freqs, size_t max_len) {
+    size_t n = freqs.size();
+    std::vector<size_t> lengths(n, 0);
+    if (n <= 1) {
+        std::fill(lengths.begin(), lengths.end(), 1);
+        return lengths;
+    }
+    if (max_len < 64 && (uint64_t(1) << max_len) < n) {
+        throw std::runtime_error("Error: the code length limit is too small for the number of symbols");
+    }
+
+    std::vector<size_t> order(n);  // the symbols sorted by their frequencies
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return freqs[a] < freqs[b]; });
+
+    struct Item {
+        uint64_t weight;
+        size_t leaf;  // the symbol or n for a package of two items of the previous level
+    };
+    // levels[0] are the leaves for the deepest level, each next level merges the leaves with the packages of the
+    // previous one
+    std::vector<std::vector<Item>> levels(max_len);
+    for (size_t level = 0; level < max_len; ++level) {
+        auto& items = levels[level];
+        items.reserve(2 * n);
+        size_t leaf = 0;
+        size_t package = 0;
+        size_t packages = level == 0 ? 0 : levels[level - 1].size() / 2;
+        while (leaf < n || package < packages) {
+            uint64_t package_weight = 0;
+            if (package < packages) {
+                package_weight = levels[level - 1][2 * package].weight + levels[level - 1][2 * package + 1].weight;
+            }
+            if (package == packages || (leaf < n && freqs[order[leaf]] <= package_weight)) {
+                items.push_back({freqs[order[leaf]], order[leaf]});
+                ++leaf;
+            } else {
+                items.push_back({package_weight, n});
+                ++package;
+            }
+        }
+    }
+
+    // the first 2n - 2 items of the top level are taken, each leaf among the taken items adds a bit to its code
+    size_t taken = 2 * n - 2;
+    for (size_t level = max_len; level-- > 0 && taken > 0;) {
+        size_t packages = 0;
+        for (size_t i = 0; i < taken; ++i) {
+            const auto& item = levels[level][i];
+            if (item.leaf == n) {
+                ++packages;
+            } else {
+                ++lengths[item.leaf];
+            }
+        }
+        taken = 2 * packages;
+    }
+    return lengths;
+}
+}  // namespace Huffman
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <ranges>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "PriorityQueue.h"
+
+namespace Huffman {
+// Huffman code lengths for the frequencies sorted in non-decreasing order, computed in place by the algorithm of
+// Moffat and Katajainen in O(n) without allocations. The lengths replace the frequencies and do not increase.
+void CodeLengthsInPlace(std::span<uint64_t> sorted_freqs);
+
+using DefaultQueuePolicy = BinaryHeapPolicy;  // the fastest one in benchmark.cpp
+
+// Huffman code lengths for the frequencies in any order by merging the trees in a priority queue picked by
+// QueuePolicy, see PriorityQueue.h. The queue and the buffers are reused by the next calls, so building the codes of
+// many small blocks does not allocate memory.
+template <class QueuePolicy = DefaultQueuePolicy>
+class HeapCodeLengthsBuilder {
+public:
+    // the lengths in the order of the frequencies, valid until the next call
+    std::span<const size_t> BuildCodeLengths(std::span<const uint64_t> freqs);
+
+private:
+    using WeightedNode = std::pair<uint64_t, uint32_t>;  // the weight of a tree and its root
+    struct LighterNode {
+        bool operator()(const WeightedNode& a, const WeightedNode& b) const {
+            return a.first < b.first;
+        }
+    };
+
+    using Queue = typename QueuePolicy::template Queue<WeightedNode, LighterNode>;
+    static_assert(PriorityQueue<Queue, WeightedNode>);
+
+    Queue queue_;
+    std::vector<uint32_t> parents_;
+    std::vector<uint32_t> depths_;
+    std::vector<size_t> lengths_;
+};
+
+std::vector<size_t> HeapCodeLengths(const std::vector<uint64_t>& freqs);  // with a HeapCodeLengthsBuilder<>
+
+// Huffman code lengths for any number of frequencies in any order in linear time: the frequencies are radix sorted
+// and the trees are merged with two queues, one of the leaves and one of the merged nodes. The buffers are reused by
+// the next calls.
+class CodeLengthsBuilder {
+public:
+    // the lengths in the order of the frequencies, valid until the next call
+    std::span<const size_t> BuildCodeLengths(std::span<const uint64_t> freqs);
+
+private:
+    void RadixSort(std::span<const uint64_t> freqs);
+
+private:
+    std::vector<uint32_t> order_;  // the indices of the frequencies in non-decreasing order of them
+    std::vector<uint32_t> sort_buffer_;
+    std::vector<uint64_t> weights_;  // the sorted leaves, then the merged nodes in the order of merging
+    std::vector<uint32_t> parents_;
+    std::vector<size_t> lengths_;
+};
+
+// Optimal code lengths for the frequencies with no code longer than max_len bits, found by package-merge in
+// O(n * max_len). The lengths are in the order of the frequencies.
+std::vector<size_t> LimitedCodeLengths(const std::vector<uint64_t>& freqs, size_t max_len);
+
+template <class QueuePolicy>
+std::span<const size_t> HeapCodeLengthsBuilder<QueuePolicy>::BuildCodeLengths(std::span<const uint64_t> freqs) {
+    size_t n = freqs.size();
+    lengths_.assign(n, 0);
+    if (n <= 1) {
+        return lengths_;
+    }
+    auto leaves = std::views::iota(size_t(0), n) |
+                  std::views::transform([&](size_t i) { return WeightedNode{freqs[i], static_cast<uint32_t>(i)}; });
+    queue_.Assign(leaves.begin(), leaves.end());
+
+    // the leaves are the nodes [0, n), the merged nodes get the next indices
+    parents_.resize(2 * n - 1);
+    for (size_t node = n; node < 2 * n - 1; ++node) {
+        auto a = queue_.Extract();
+        auto b = queue_.Extract();
+        parents_[a.second] = node;
+        parents_[b.second] = node;
+        queue_.Emplace(a.first + b.first, node);
+    }
+    queue_.Clear();
+
+    depths_.resize(2 * n - 1);
+    depths_[2 * n - 2] = 0;
+    for (size_t node = 2 * n - 2; node-- > 0;) {
+        depths_[node] = depths_[parents_[node]] + 1;
+    }
+    std::copy(depths_.begin(), depths_.begin() + n, lengths_.begin());
+    return lengths_;
+}
+}  // namespace Huffman
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+// An implicit heap in a vector where each node has Arity children. Wider nodes make the heap shallower, so fewer
+// levels are moved by Extract(), at the cost of more comparisons per level.
+template <class T, class Compare = std::less<T>, size_t Arity = 2>
+class DaryHeap {
+public:
+    template <class Iterator>
+    void Assign(Iterator first, Iterator last);  // replaces the values, builds the heap bottom-up in O(n)
+    template <class... Args>
+    void Emplace(Args&&... args);
+    void Insert(const T& value);
+    void Insert(T&& value);
+    T Extract();  // moves the value out
+    [[nodiscard]] const T& Top() const;
+    [[nodiscard]] bool Empty() const;
+    [[nodiscard]] size_t Size() const;
+    void Clear();  // keeps the memory of the values
+
+private:
+    void SiftUp(size_t pos);
+    void SiftDown(size_t pos);
+
+    static_assert(Arity >= 2, "a heap node needs at least two children");
+    std::vector<T> values_;
+};
+
+template <class T, class Compare, size_t Arity>
+template <class Iterator>
+void DaryHeap<T, Compare, Arity>::Assign(Iterator first, Iterator last) {
+    values_.clear();
+    for (; first != last; ++first) {
+        values_.emplace_back(*first);
+    }
+    for (size_t pos = values_.size() / Arity + 1; pos-- > 0;) {
+        SiftDown(pos);
+    }
+}
+
+template <class T, class Compare, size_t Arity>
+template <class... Args>
+void DaryHeap<T, Compare, Arity>::Emplace(Args&&... args) {
+    values_.emplace_back(std::forward<Args>(args)...);
+    SiftUp(values_.size() - 1);
+}
+
+template <class T, class Compare, size_t Arity>
+void DaryHeap<T, Compare, Arity>::Insert(const T& value) {
+    Emplace(value);
+}
+
+template <class T, class Compare, size_t Arity>
+void DaryHeap<T, Compare, Arity>::Insert(T&& value) {
+    Emplace(std::move(value));
+}
+
+template <class T, class Compare, size_t Arity>
+T DaryHeap<T, Compare, Arity>::Extract() {
+    if (Empty()) {
+        throw std::runtime_error("Error: Extracting from an empty heap");
+    }
+    T top = std::move(values_.front());
+    if (values_.size() > 1) {
+        values_.front() = std::move(values_.back());
+    }
+    values_.pop_back();
+    if (!values_.empty()) {
+        SiftDown(0);
+    }
+    return top;
+}
+
+template <class T, class Compare, size_t Arity>
+const T& DaryHeap<T, Compare, Arity>::Top() const {
+    if (Empty()) {
+        throw std::runtime_error("Error: No top element in an empty heap");
+    }
+    return values_.front();
+}
+
+template <class T, class Compare, size_t Arity>
+bool DaryHeap<T, Compare, Arity>::Empty() const {
+    return values_.empty();
+}
+
+template <class T, class Compare, size_t Arity>
+size_t DaryHeap<T, Compare, Arity>::Size() const {
+    return values_.size();
+}
+
+template <class T, class Compare, size_t Arity>
+void DaryHeap<T, Compare, Arity>::Clear() {
+    values_.clear();
+}
+
+template <class T, class Compare, size_t Arity>
+void DaryHeap<T, Compare, Arity>::SiftUp(size_t pos) {
+    T value = std::move(values_[pos]);  // the hole moves up instead of swapping the values
+    while (pos > 0) {
+        size_t parent = (pos - 1) / Arity;
+        if (!Compare()(value, values_[parent])) {
+            break;
+        }
+        values_[pos] = std::move(values_[parent]);
+        pos = parent;
+    }
+    values_[pos] = std::move(value);
+}
+
+template <class T, class Compare, size_t Arity>
+void DaryHeap<T, Compare, Arity>::SiftDown(size_t pos) {
+    if (pos >= values_.size()) {
+        return;
+    }
+    T value = std::move(values_[pos]);
+    while (true) {
+        size_t first_child = pos * Arity + 1;
+        if (first_child >= values_.size()) {
+            break;
+        }
+        size_t last_child = std::min(first_child + Arity, values_.size());
+        size_t best = first_child;
+        for (size_t child = first_child + 1; child < last_child; ++child) {
+            if (Compare()(values_[child], values_[best])) {
+                best = child;
+            }
+        }
+        if (!Compare()(values_[best], value)) {
+            break;
+        }
+        values_[pos] = std::move(values_[best]);
+        pos = best;
+    }
+    values_[pos] = std::move(value);
+}
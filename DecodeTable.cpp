@@ -0,0 +1,95 @@
+#include "DecodeTable.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace Huffman {
+const size_t BITS_IN_CHAR = 8;
+const size_t MAX_TABLE_BITS = 11;  // 2^11 entries fit into L1 cache
+const size_t MAX_CODE_LENGTH = 64;
+
+void DecodeTable::Build(const std::vector<Symbol>& symbols, const std::vector<size_t>& length_counts, BitOrder order) {
+    size_t max_len = length_counts.empty() ? 0 : length_counts.size() - 1;
+    if (max_len > MAX_CODE_LENGTH) {
+        throw std::runtime_error("Error: Huffman code is too long");
+    }
+    order_ = order;
+    table_bits_ = std::min(max_len, MAX_TABLE_BITS);
+    entries_.assign(size_t(1) << table_bits_, {});
+    symbols_.clear();
+    for (const auto& symbol : symbols) {
+        symbols_.emplace_back(symbol.to_ulong());
+    }
+    first_code_.assign(length_counts.size(), 0);
+    limit_.assign(length_counts.size(), 0);
+    index_.assign(length_counts.size(), 0);
+
+    size_t ptr = 0;
+    uint64_t code = 0;
+    for (size_t len = 1; len < length_counts.size(); ++len, code <<= 1) {
+        if (len < MAX_CODE_LENGTH && code + length_counts[len] > (uint64_t(1) << len)) {
+            throw std::runtime_error("Error: too many symbols with some code length");
+        }
+        first_code_[len] = code;
+        limit_[len] = code + length_counts[len];
+        index_[len] = ptr;
+        for (size_t i = 0; i < length_counts[len]; ++i, ++code, ++ptr) {
+            if (ptr == symbols.size()) {
+                throw std::runtime_error("Error: too many symbols with some code length");
+            }
+            if (len > table_bits_) {
+                continue;
+            }
+            // all the entries for the bits which start with the code
+            Entry entry{static_cast<uint16_t>(symbols[ptr].to_ulong()), static_cast<uint8_t>(len)};
+            size_t suffix_bits = table_bits_ - len;
+            for (uint64_t suffix = 0; suffix < (uint64_t(1) << suffix_bits); ++suffix) {
+                if (order == BitOrder::LsbFirst) {
+                    entries_[ReverseBits(code, len) | (suffix << len)] = entry;
+                } else {
+                    entries_[(code << suffix_bits) | suffix] = entry;
+                }
+            }
+        }
+    }
+    BuildRuns(order);
+}
+
+void DecodeTable::BuildRuns(BitOrder order) {
+    runs_.assign(entries_.size(), {});
+    uint64_t mask = entries_.size() - 1;
+    for (uint64_t index = 0; index < entries_.size(); ++index) {
+        auto& run = runs_[index];
+        uint64_t bits = index;  // the bits left in the window, the next code is looked up by them
+        while (run.count < MAX_RUN) {
+            const auto& entry = entries_[bits];
+            if (entry.len == 0 || run.len + entry.len > table_bits_ || entry.symbol >= 1 << BITS_IN_CHAR) {
+                break;  // the code does not fit into the rest of the window or is not a byte
+            }
+            run.bytes[run.count++] = static_cast<char>(entry.symbol);
+            run.len += entry.len;
+            bits = order == BitOrder::LsbFirst ? bits >> entry.len : (bits << entry.len) & mask;
+        }
+    }
+}
+
+Symbol DecodeTable::DecodeLong(BitReader& bin_in) const {
+    uint64_t code = bin_in.Peek(table_bits_);  // no code of table_bits_ or less matches
+    if (order_ == BitOrder::LsbFirst) {
+        code = ReverseBits(code, table_bits_);
+    }
+    bin_in.Skip(table_bits_);
+    for (size_t len = table_bits_ + 1; len < limit_.size(); ++len) {
+        code = (code << 1) | bin_in.Peek(1);
+        bin_in.Skip(1);
+        if (code < limit_[len]) {
+            return symbols_[index_[len] + (code - first_code_[len])];
+        }
+    }
+    throw std::runtime_error("Error: The file is invalid, unable to find the symbol for encoded data");
+}
+
+size_t DecodeTable::TableBits() const {
+    return table_bits_;
+}
+}  // namespace Huffman
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "BitIO.h"
+#include "HuffmanTree.h"
+
+namespace Huffman {
+// Decodes canonical Huffman codes with a single lookup of the next TableBits() bits of the stream
+class DecodeTable {
+public:
+    constexpr static const size_t MAX_RUN = 8;
+
+    struct Entry {
+        uint16_t symbol = 0;
+        uint8_t len = 0;  // zero if the code is longer than TableBits() or the bits are not a code
+    };
+
+    // all the byte codes which fit into TableBits() together, up to MAX_RUN of them
+    struct Run {
+        std::array<char, MAX_RUN> bytes{};
+        uint8_t count = 0;  // zero if the first code is not a byte or is longer than TableBits()
+        uint8_t len = 0;    // of all count codes
+    };
+
+    // symbols are ordered by their codes, length_counts[len] is the number of codes of length len
+    void Build(const std::vector<Symbol>& symbols, const std::vector<size_t>& length_counts, BitOrder order);
+    // the entry for the code at the start of the stream, its bits are not consumed
+    const Entry& Lookup(BitReader& bin_in) const {
+        return entries_[bin_in.Peek(table_bits_)];
+    }
+    const Run& LookupRun(BitReader& bin_in) const {
+        return runs_[bin_in.Peek(table_bits_)];
+    }
+    Symbol Decode(BitReader& bin_in) const {  // consumes the code
+        const auto& entry = Lookup(bin_in);
+        if (entry.len == 0) {
+            return DecodeLong(bin_in);
+        }
+        bin_in.Skip(entry.len);
+        return entry.symbol;
+    }
+    [[nodiscard]] size_t TableBits() const;
+
+private:
+    void BuildRuns(BitOrder order);
+    Symbol DecodeLong(BitReader& bin_in) const;  // bit by bit with the canonical code arrays
+
+private:
+    std::vector<Entry> entries_;
+    std::vector<Run> runs_;
+    size_t table_bits_ = 0;
+    BitOrder order_ = BitOrder::MsbFirst;
+    // the codes of length len are [first_code_[len], limit_[len]), the first of them is for symbols_[index_[len]]
+    std::vector<uint64_t> first_code_;
+    std::vector<uint64_t> limit_;
+    std::vector<size_t> index_;
+    std::vector<uint16_t> symbols_;
+};
+}  // namespace Huffman
@@ -1,244 +1,774 @@
 #include "HuffmanCodec.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cstring>
 #include <filesystem>
 #include <iostream>
-#include <queue>
-#include <tuple>
 
-#include "LeftistHeap.h"
+#include "ByteHistogram.h"
 
 namespace Huffman {
-Coder::Coder(std::ofstream& out) : bin_out_(out) {
+const uint64_t MIN_PREALLOCATION = 1 << 20;
+const size_t BITS_IN_BYTE = 8;
+const size_t BITS_IN_FILE_SIZE = 64;
+const size_t BITS_IN_BLOCK_SIZE = 32;
+const size_t BITS_IN_INDEX_ENTRY = 64;
+
+namespace {
+BitOrder StreamBitOrder(uint8_t format_version) {
+    return format_version == LEGACY_FORMAT ? BitOrder::MsbFirst : BitOrder::LsbFirst;
+}
+
+Symbol ByteSymbol(char c) {
+    return static_cast<unsigned char>(c);
+}
+
+std::unique_ptr<ByteSource> OpenInputFile(const std::string& file_name, const Options& options) {
+    return options.io_backend ? OpenAsyncFileSource(file_name, options.io_backend) : OpenFileSource(file_name);
+}
+
+std::unique_ptr<ByteSink> CreateOutputFile(const std::string& file_name, const Options& options) {
+    return options.io_backend ? CreateAsyncFileSink(file_name, options.io_backend) : CreateFileSink(file_name);
+}
+}  // namespace
+
+Coder::Coder(std::ofstream& out) : Coder(std::make_unique<StreamSink>(out)) {
+}
+
+Coder::Coder(std::unique_ptr<ByteSink> sink, Options options)
+    : options_(std::move(options)), bin_out_(std::move(sink), StreamBitOrder(options_.format_version)) {
+    WriteArchiveHeader();
+}
+
+Coder::Coder(ByteSink& sink, Options options)
+    : options_(std::move(options)), bin_out_(sink, StreamBitOrder(options_.format_version)) {
+    WriteArchiveHeader();
+}
+
+Coder::Coder(ByteSink& sink, Options options, MemberOnly)
+    : options_(std::move(options)), bin_out_(sink, StreamBitOrder(options_.format_version)), member_only_(true) {
+    WriteArchiveHeader();
+}
+
+void Coder::WriteArchiveHeader() {
+    if (options_.format_version != LEGACY_FORMAT && options_.format_version != FORMAT_VERSION) {
+        throw std::runtime_error("Error: unable to write archive format version " +
+                                 std::to_string(options_.format_version));
+    }
+    if (options_.max_code_length < MIN_CODE_LENGTH_LIMIT || options_.max_code_length > MAX_CODE_LENGTH_LIMIT) {
+        throw std::runtime_error("Error: the code length limit should be from " +
+                                 std::to_string(MIN_CODE_LENGTH_LIMIT) + " to " +
+                                 std::to_string(MAX_CODE_LENGTH_LIMIT));
+    }
+    if (options_.block_size != 0 && (options_.block_size < MIN_BLOCK_SIZE || options_.block_size > MAX_BLOCK_SIZE)) {
+        throw std::runtime_error("Error: the block size should be zero or from " + std::to_string(MIN_BLOCK_SIZE) +
+                                 " to " + std::to_string(MAX_BLOCK_SIZE) + " bytes");
+    }
+    if (options_.format_version != LEGACY_FORMAT && !member_only_) {
+        bin_out_.Write(0, BITS_IN_BYTE);
+        bin_out_.Write(options_.format_version, BITS_IN_BYTE);
+        bin_out_.Write(options_.max_code_length, BITS_IN_BYTE);
+        bin_out_.Write(1, BITS_IN_BYTE);  // the streams count
+        bin_out_.Write(options_.block_size, BITS_IN_BLOCK_SIZE);
+    }
 }
 
 void Coder::Reset() {
-    canonical_codes_.clear();
-    symbols_ordered_by_codes_.clear();
+    canonical_codes_.Clear();
     first_file_ = false;
 }
 
 void Coder::AddFile(const std::string& file_name) {
-    if (!first_file_) {
-        if (!canonical_codes_.contains(ONE_MORE_FILE)) {
+    if (!std::filesystem::exists(file_name)) {
+        throw std::runtime_error("Error: No such file " + file_name);
+    }
+    auto source = OpenInputFile(file_name, options_);
+    AddFile(file_name, *source);
+}
+
+void Coder::StartMember() {
+    if (!first_file_ && !member_only_) {
+        if (canonical_codes_[ONE_MORE_FILE.to_ullong()].len == 0) {
             throw std::runtime_error("Error: could not encode file because ONE_MORE_FILE canonical code was not found");
         }
-        bin_out_.Write(canonical_codes_[ONE_MORE_FILE]);
+        WriteCode(ONE_MORE_FILE);
+        if (options_.format_version >= ALIGNED_MEMBERS_VERSION) {
+            bin_out_.AlignToByte();
+        }
     }
     Reset();
-    std::unordered_map<Symbol, size_t> symbol_freq;
+}
 
-    for (auto c : file_name) {
-        ++symbol_freq[Symbol(c)];
+void Coder::AddFile(const std::string& file_name, ByteSource& source) {
+    StartMember();
+    if (HasIndex()) {
+        index_.push_back({bin_out_.Position() / BITS_IN_BYTE, 0, {}});
+    }
+    ByteHistogram histogram;
+    histogram.Add(file_name);
+    file_size_ = 0;
+    // a read input is kept in file_buffer_ while it fits, so that it is encoded without reading it for the second time;
+    // a mapped input and a longer one are still read twice
+    bool buffered = !source.InMemory();
+    file_buffer_.clear();
+    // the blocks have their own codes, so the codes of the member are built without reading the file
+    if (BlockSize() == 0) {
+        for (auto chunk = source.Next(); !chunk.empty(); chunk = source.Next()) {
+            histogram.Add(chunk);
+            file_size_ += chunk.size();
+            if (buffered && file_size_ > options_.read_buffer_limit) {
+                buffered = false;
+                file_buffer_.clear();
+            } else if (buffered) {
+                file_buffer_.insert(file_buffer_.end(), chunk.begin(), chunk.end());
+            }
+        }
+    }
+    if (BlockSize() == 0 && !buffered && !source.Rewind()) {
+        throw std::runtime_error("Error: unable to read " + file_name + " for the second time");
     }
-    ++symbol_freq[FILENAME_END];
 
-    if (!std::filesystem::exists(file_name)) {
-        throw std::runtime_error("Error: No such file" + file_name);
+    SymbolFreqs symbol_freq{};
+    auto byte_freq = histogram.Counts();
+    std::copy(byte_freq.begin(), byte_freq.end(), symbol_freq.begin());
+    ++symbol_freq[FILENAME_END.to_ullong()];
+    ++symbol_freq[ONE_MORE_FILE.to_ullong()];
+    ++symbol_freq[ARCHIVE_END.to_ullong()];
+    canonical_codes_.Build(symbol_freq, options_.max_code_length);
+    member_bits_ = CountMemberBits(symbol_freq);
+    bin_out_.Preallocate(std::max(MemberBits(false), MemberBits(true)));
+    if (BlockSize() == 0 && buffered) {
+        MemorySource buffer_source(file_buffer_);
+        Encode(file_name, buffer_source);
+    } else {
+        Encode(file_name, source);
+    }
+    if (HasIndex()) {
+        index_.back().file_size = file_size_;
+    }
+}
+
+uint64_t Coder::CountMemberBits(const SymbolFreqs& symbol_freq) const {
+    uint64_t bits = 0;
+    for (size_t symbol = 0; symbol < SYMBOLS_AMOUNT; ++symbol) {
+        if (symbol != ONE_MORE_FILE.to_ullong() && symbol != ARCHIVE_END.to_ullong()) {  // only one of them is written
+            bits += symbol_freq[symbol] * canonical_codes_[symbol].len;
+        }
     }
-    std::ifstream in(file_name, std::ios::binary);
-    while (in.peek() != EOF) {
-        char c = in.get();
-        ++symbol_freq[Symbol(c)];
+    bits += canonical_codes_.TableBits();  // the header
+    if (BlockSize() > 0) {  // the blocks are counted as they are written
+        return bits;
     }
-    in.close();
+    return options_.format_version == LEGACY_FORMAT ? bits : bits + BITS_IN_FILE_SIZE;
+}
+
+size_t Coder::BlockSize() const {
+    return options_.format_version == LEGACY_FORMAT ? 0 : options_.block_size;
+}
 
-    ++symbol_freq[ONE_MORE_FILE];
-    ++symbol_freq[ARCHIVE_END];
-    MakeCanonicalCodes(symbol_freq);
-    Encode(file_name);
+uint64_t Coder::MemberBits(bool last_member) const {
+    return member_bits_ + canonical_codes_[(last_member ? ARCHIVE_END : ONE_MORE_FILE).to_ullong()].len;
 }
 
-void Coder::MakeCanonicalCodes(std::unordered_map<Symbol, size_t>& symbol_freq) {
-    using WeightedTree = std::pair<size_t, HuffmanTree*>;
-    auto cmp = [](const WeightedTree& a, const WeightedTree& b) { return a.first < b.first; };
-    LeftistHeap<WeightedTree, decltype(cmp)> queue;
-    for (const auto& [symbol, freq] : symbol_freq) {
-        auto* new_tree = new HuffmanTree(symbol);
-        queue.Insert({freq, new_tree});
+void Coder::WriteCode(const Symbol& symbol) {
+    const auto& code = canonical_codes_[symbol.to_ullong()];
+    bin_out_.Write(code.bits, code.len);
+}
+
+void Coder::Encode(const std::string& file_name, ByteSource& source) {
+    canonical_codes_.WriteTable(bin_out_);
+
+    if (options_.format_version != LEGACY_FORMAT && BlockSize() == 0) {
+        bin_out_.Write(file_size_, BITS_IN_FILE_SIZE);
     }
 
-    while (queue.Size() > 1) {
-        auto a = queue.Extract();
-        auto b = queue.Extract();
-        auto new_tree = HuffmanTree::Merge(*a.second, *b.second);
-        queue.Insert({a.first + b.first, new_tree});
+    for (char c : file_name) {  // encode file name
+        WriteCode(ByteSymbol(c));
     }
 
-    auto code_lengths_per_symbol = queue.Top().second->GetCodeLengthsForSymbols();
-    if (code_lengths_per_symbol.empty()) {
-        throw std::runtime_error("Error: Failed to get canonical codes for symbols");
+    WriteCode(FILENAME_END);
+
+    if (BlockSize() > 0) {
+        EncodeBlocks(source);
+        return;
+    }
+    for (auto chunk = source.Next(); !chunk.empty(); chunk = source.Next()) {  // encode file body
+        WriteCodes(chunk, canonical_codes_, bin_out_);
     }
-    MakeCanonicalCodes(code_lengths_per_symbol);
 }
 
-void Coder::MakeCanonicalCodes(std::vector<std::pair<Symbol, size_t>>& code_length_per_symbol) {
-    std::sort(code_length_per_symbol.begin(), code_length_per_symbol.end(), [&](const auto& a, const auto& b) {
-        auto a_symbol = a.first.to_ullong();
-        auto b_symbol = b.first.to_ullong();
-        return std::tie(a.second, a_symbol) < std::tie(b.second, b_symbol);
-    });
-    uint64_t code = 0;
-    for (size_t i = 0; i < code_length_per_symbol.size(); ++i) {
-        size_t len = code_length_per_symbol[i].second;
-        Symbol symbol = code_length_per_symbol[i].first;
-
-        symbols_ordered_by_codes_.emplace_back(symbol);
-
-        {
-            uint64_t code_copy = code;
-            for (size_t bit = 0; bit < len; ++bit) {
-                canonical_codes_[symbol].emplace_back((code_copy & 1) == 1);
-                code_copy >>= 1;
-            }
-            std::reverse(canonical_codes_[symbol].begin(), canonical_codes_[symbol].end());
+void Coder::EncodeBlocks(ByteSource& source) {
+    if (!pool_ && options_.threads != 1) {  // a single thread encodes the blocks itself
+        pool_ = std::make_unique<ThreadPool>(options_.threads);
+    }
+    auto block = NewBlockJob();
+    for (auto chunk = source.Next(); !chunk.empty(); chunk = source.Next()) {
+        file_size_ += chunk.size();
+        while (source.InMemory() && !chunk.empty()) {  // the chunk stays valid, so its blocks are not copied
+            auto job = NewBlockJob();
+            job.bytes = chunk.first(std::min(BlockSize(), chunk.size()));
+            chunk = chunk.subspan(job.bytes.size());
+            SubmitBlock(std::move(job));
         }
-        if (i + 1 < code_length_per_symbol.size()) {
-            size_t next_len = code_length_per_symbol[i + 1].second;
-            code = (code + 1) << (next_len - len);
+        while (!chunk.empty()) {
+            size_t size = std::min(BlockSize() - block.data.size(), chunk.size());
+            block.data.insert(block.data.end(), chunk.begin(), chunk.begin() + size);
+            chunk = chunk.subspan(size);
+            if (block.data.size() == BlockSize()) {
+                block.bytes = block.data;
+                SubmitBlock(std::move(block));
+                block = NewBlockJob();
+            }
         }
     }
+    if (!block.data.empty()) {
+        block.bytes = block.data;
+        SubmitBlock(std::move(block));
+    } else {
+        spare_blocks_.emplace_back(std::move(block));
+    }
+    while (!blocks_.empty()) {
+        WriteBlock();
+    }
+    bin_out_.AlignToByte();
+    bin_out_.Write(0, BITS_IN_BLOCK_SIZE);  // the end of the body
+    member_bits_ += BITS_IN_BYTE - 1 + BITS_IN_BLOCK_SIZE;
 }
 
-void Coder::Write(const Symbol& symbol) {
-    bin_out_.Write(symbol.to_ullong(), BITS_IN_SYMBOL);
+Coder::BlockJob Coder::NewBlockJob() {
+    if (spare_blocks_.empty()) {
+        return {{}, {}, std::make_unique<BlockEncoder>(options_.max_code_length), {}, {}};
+    }
+    auto job = std::move(spare_blocks_.back());
+    spare_blocks_.pop_back();
+    job.data.clear();
+    job.bytes = {};
+    return job;
 }
 
-void Coder::Encode(const std::string& file_name) {
-    bin_out_.Write(symbols_ordered_by_codes_.size(), BITS_IN_SYMBOL);  // SYMBOLS_COUNT, 9 bits
+void Coder::SubmitBlock(BlockJob job) {
+    if (!pool_) {
+        job.encoded = job.encoder->Encode(job.bytes);
+        blocks_.emplace_back(std::move(job));
+        WriteBlock();
+        return;
+    }
+    if (blocks_.size() == 2 * pool_->Size()) {  // bounds the memory of the blocks in flight
+        WriteBlock();
+    }
+    blocks_.emplace_back(std::move(job));
+    auto& block = blocks_.back();  // the elements of a deque stay in place until they are erased
+    block.done = pool_->Submit([&block] { block.encoded = block.encoder->Encode(block.bytes); });
+}
 
-    for (const auto& symbol : symbols_ordered_by_codes_) {  // Symbols in canonical codes order, each has 9 bits
-        Write(symbol);
+void Coder::WriteBlock() {
+    auto& block = blocks_.front();
+    if (block.done.valid()) {
+        block.done.get();
+    }
+    bin_out_.AlignToByte();
+    if (HasIndex()) {
+        index_.back().blocks.push_back(bin_out_.Position() / BITS_IN_BYTE);
     }
+    uint64_t bits = 2 * BITS_IN_BLOCK_SIZE + block.encoded.size() * BITS_IN_BYTE;
+    bin_out_.Preallocate(bits);
+    bin_out_.Write(block.bytes.size(), BITS_IN_BLOCK_SIZE);
+    bin_out_.Write(block.encoded.size(), BITS_IN_BLOCK_SIZE);
+    bin_out_.WriteBytes(block.encoded);
+    member_bits_ += BITS_IN_BYTE - 1 + bits;
+    spare_blocks_.emplace_back(std::move(block));
+    blocks_.pop_front();
+}
 
-    {  // the amount of symbols with each code length
-        std::vector<size_t> count_symbols_with_code_len;
-        for (const auto& [symbol, code] : canonical_codes_) {
-            size_t len = code.size();
-            while (count_symbols_with_code_len.size() < len) {
-                count_symbols_with_code_len.emplace_back(0);
+void Coder::AddFiles(const std::vector<std::string>& file_names) {
+    if (!pool_) {
+        pool_ = std::make_unique<ThreadPool>(options_.threads);
+    }
+    std::deque<MemberJob> members;  // submitted in the order of the files
+    try {
+        for (const auto& file_name : file_names) {
+            if (!IsSmallFile(file_name)) {  // its blocks are encoded on the pool once the previous members are added
+                for (; !members.empty(); members.pop_front()) {
+                    WriteMember(members.front());
+                }
+                AddFile(file_name);
+                continue;
             }
-            ++count_symbols_with_code_len[len - 1];
+            if (members.size() == 2 * pool_->Size()) {  // bounds the memory of the members in flight
+                WriteMember(members.front());
+                members.pop_front();
+            }
+            SubmitMember(members, file_name);
+        }
+        for (; !members.empty(); members.pop_front()) {
+            WriteMember(members.front());
         }
-        for (size_t symbols_amount : count_symbols_with_code_len) {
-            bin_out_.Write(symbols_amount, BITS_IN_SYMBOL);
+    } catch (...) {  // the tasks refer to the members
+        for (auto& member : members) {
+            if (member.done.valid()) {
+                member.done.wait();
+            }
         }
+        throw;
     }
+}
 
-    for (char c : file_name) {  // encode file name
-        bin_out_.Write(canonical_codes_[Symbol(c)]);
+bool Coder::IsSmallFile(const std::string& file_name) const {
+    std::error_code error;
+    uint64_t size = std::filesystem::file_size(file_name, error);  // a file of unknown size is not small
+    size_t limit = options_.member_buffer_limit;
+    if (BlockSize() > 0) {
+        limit = std::min(limit, BlockSize());
     }
+    return !error && size < limit;
+}
 
-    bin_out_.Write(canonical_codes_[FILENAME_END]);
+Coder::MemberJob Coder::NewMemberJob() {
+    if (spare_members_.empty()) {
+        MemberJob job;
+        job.sink = std::make_unique<VectorSink>();
+        Options member_options = options_;
+        member_options.threads = 1;  // a small member has less than a block
+        if (options_.io_backend) {   // a backend is used by one thread at a time
+            member_options.io_backend = CreateAsyncIoBackend(options_.io_backend->QueueDepth());
+        }
+        job.coder.reset(new Coder(*job.sink, member_options, MemberOnly{}));
+        return job;
+    }
+    auto job = std::move(spare_members_.back());
+    spare_members_.pop_back();
+    job.sink->Clear();
+    return job;
+}
 
-    if (!std::filesystem::exists(file_name)) {
-        throw std::runtime_error("Error: No such file " + file_name);
+void Coder::SubmitMember(std::deque<MemberJob>& members, const std::string& file_name) {
+    members.emplace_back(NewMemberJob());
+    auto& member = members.back();  // the elements of a deque stay in place until they are erased
+    member.done = pool_->Submit([&member, file_name] {
+        member.coder->AddFile(file_name);
+        size_t padding = member.coder->bin_out_.PaddingBits();
+        member.coder->bin_out_.Flush();
+        member.bits = member.sink->Size() * BITS_IN_BYTE - padding;
+    });
+}
+
+void Coder::WriteMember(MemberJob& member) {
+    member.done.get();
+    StartMember();
+    if (HasIndex()) {  // the offsets of the member are shifted to its place in the archive
+        auto entry = std::move(member.coder->index_.back());
+        member.coder->index_.clear();
+        uint64_t offset = bin_out_.Position() / BITS_IN_BYTE;
+        for (auto& block : entry.blocks) {
+            block = block - entry.offset + offset;
+        }
+        entry.offset = offset;
+        index_.emplace_back(std::move(entry));
+    }
+    bin_out_.Preallocate(member.bits);
+    bin_out_.WriteStream(std::span(member.sink->Data()).first(member.sink->Size()), member.bits);
+    // the codes of the member end it in the next AddFile() or Close()
+    std::swap(canonical_codes_, member.coder->canonical_codes_);
+    member_bits_ = member.coder->member_bits_;
+    spare_members_.emplace_back(std::move(member));
+}
+
+void Coder::Close() {
+    if (closed_) {
+        return;
+    }
+    closed_ = true;
+    if (!first_file_ && !member_only_) {
+        WriteCode(ARCHIVE_END);
+        if (HasIndex()) {
+            WriteIndex();
+        }
     }
-    std::ifstream in(file_name, std::ios::binary);
+    bin_out_.Close();
+}
+
+bool Coder::HasIndex() const {
+    return options_.format_version >= INDEX_VERSION;
+}
 
-    while (in.peek() != EOF) {  // encode file body
-        char c = in.get();
-        bin_out_.Write(canonical_codes_[Symbol(c)]);
+uint64_t Coder::IndexBits() const {
+    if (!HasIndex()) {
+        return 0;
+    }
+    uint64_t entries = 2 + 3 * index_.size();  // the number of members and the offset of the index
+    for (const auto& member : index_) {
+        entries += member.blocks.size();
     }
-    in.close();
+    return entries * BITS_IN_INDEX_ENTRY;
+}
+
+void Coder::WriteIndex() {
+    bin_out_.AlignToByte();
+    uint64_t index_offset = bin_out_.Position() / BITS_IN_BYTE;
+    bin_out_.Preallocate(IndexBits());
+    bin_out_.Write(index_.size(), BITS_IN_INDEX_ENTRY);
+    for (const auto& member : index_) {
+        bin_out_.Write(member.offset, BITS_IN_INDEX_ENTRY);
+        bin_out_.Write(member.file_size, BITS_IN_INDEX_ENTRY);
+        bin_out_.Write(member.blocks.size(), BITS_IN_INDEX_ENTRY);
+        for (auto block : member.blocks) {
+            bin_out_.Write(block, BITS_IN_INDEX_ENTRY);
+        }
+    }
+    bin_out_.Write(index_offset, BITS_IN_INDEX_ENTRY);
 }
 
 Coder::~Coder() {
-    bin_out_.Write(canonical_codes_[ARCHIVE_END]);
+    try {
+        Close();
+    } catch (std::runtime_error&) {  // call Close() explicitly to get the error
+    }
 }
 
-Decoder::Decoder(std::ifstream& in) : bin_in_(in) {
-    symbols_count_ = 0;
+Decoder::Decoder(std::ifstream& in) : source_(std::make_unique<StreamSource>(in)), bin_in_(*source_) {
+}
+
+Decoder::Decoder(const std::string& archive_name, Options options)
+    : options_(std::move(options)), source_(OpenInputFile(archive_name, options_)), bin_in_(*source_) {
+}
+
+Decoder::Decoder(std::unique_ptr<ByteSource> source, Options options)
+    : options_(std::move(options)), source_(std::move(source)), bin_in_(*source_) {
+}
+
+Decoder::Decoder(std::span<const char> member, const Decoder& archive)
+    : options_(archive.options_),
+      source_(std::make_unique<MemorySource>(member)),
+      bin_in_(*source_, StreamBitOrder(archive.format_version_)),
+      format_version_(archive.format_version_),
+      max_code_length_(archive.max_code_length_),
+      block_size_(archive.block_size_),
+      member_only_(true) {
+    options_.io_backend = nullptr;  // the backend is not shared between the threads
 }
 
 void Decoder::Reset() {
-    symbols_count_ = 0;
-    symbols_.clear();
-    canonical_codes_.clear();
+    file_size_.reset();
 }
 
-size_t Decoder::ReadAmount() {
-    size_t res = 0;
-    auto code = bin_in_.Get(BITS_IN_SYMBOL);
-    for (size_t bit = 0; bit < BITS_IN_SYMBOL; ++bit) {
-        res |= code[bit] << bit;
+void Decoder::ReadArchiveHeader() {
+    // a legacy archive starts with a nonzero symbol count, so its first byte is never zero unless it has all 256
+    // bytes, and then the highest bit of the second byte is set
+    uint64_t magic = bin_in_.Peek(2 * BITS_IN_BYTE);
+    if ((magic >> BITS_IN_BYTE) != 0 || (magic & 0x80) != 0) {
+        format_version_ = LEGACY_FORMAT;
+        return;
+    }
+    format_version_ = magic & 0xFF;
+    if (format_version_ == LEGACY_FORMAT || format_version_ > FORMAT_VERSION) {
+        throw std::runtime_error("Error: unsupported archive format version " + std::to_string(format_version_));
+    }
+    bin_in_.Consume(2 * BITS_IN_BYTE);
+    bin_in_.SetBitOrder(StreamBitOrder(format_version_));
+    if (format_version_ >= CODE_LENGTH_LIMIT_VERSION) {
+        max_code_length_ = bin_in_.Read(BITS_IN_BYTE);
+    }
+    if (format_version_ >= STREAMS_VERSION && bin_in_.Read(BITS_IN_BYTE) != 1) {
+        throw std::runtime_error("Error: archives with several streams are not supported");
+    }
+    if (format_version_ >= BLOCKS_VERSION) {
+        block_size_ = bin_in_.Read(BITS_IN_BLOCK_SIZE);
+        if (block_size_ > MAX_BLOCK_SIZE) {
+            throw std::runtime_error("Error: the block size of the archive is too large");
+        }
+        if (block_size_ > 0) {
+            block_decoder_.emplace(max_code_length_);
+        }
+    }
+}
+
+void Decoder::CheckOverrun() const {
+    if (bin_in_.Status() == ReadStatus::Overrun) {
+        throw std::runtime_error("Error: unexpected end of file");
     }
-    return res;
 }
 
 void Decoder::Decode() {
+    ReadArchiveHeader();
+    // the sources in memory return the whole archive as a single chunk
+    if (format_version_ >= INDEX_VERSION && options_.threads != 1 && source_->InMemory() && source_->Rewind()) {
+        DecodeIndexed(source_->Next());
+        return;
+    }
     bool files_ended = false;
     while (!files_ended) {
-        Reset();
-
-        symbols_count_ = ReadAmount();
-
-        for (size_t i = 0; i < symbols_count_; ++i) {  // get symbols in the order of canonical codes
-            Code bits = bin_in_.Get(BITS_IN_SYMBOL);
-            Symbol symbol;
-            for (size_t bit = 0; bit < BITS_IN_SYMBOL; ++bit) {
-                symbol[bit] = bits[bit];
-            }
-            symbols_.emplace_back(symbol);
-        }
-
-        {  // find canonical codes for symbols
-            size_t ptr = 0;
-            size_t value = 0;
-            for (size_t len = 1; ptr < symbols_count_; ++len) {
-                size_t cnt_symbols_with_len = ReadAmount();
-                for (size_t iteration = 0; iteration < cnt_symbols_with_len; ++iteration) {
-                    size_t value_copy = value;
-                    Code code;
-                    for (size_t bit = 0; bit < len; ++bit) {
-                        code.emplace_back(value_copy % 2);
-                        value_copy >>= 1;
-                    }
-                    std::reverse(code.begin(), code.end());
-                    if (ptr == symbols_count_) {
-                        throw std::runtime_error("Error: too many symbols with some code length");
-                    }
-                    canonical_codes_[code] = symbols_[ptr++];
-                    ++value;
-                }
-                value <<= 1;
-            }
+        files_ended = DecodeMember();
+        if (!files_ended && format_version_ >= ALIGNED_MEMBERS_VERSION) {
+            bin_in_.AlignToByte();
         }
+    }
+}
 
-        HuffmanTree huffman_tree;
-        for (auto& [code, symbol] : canonical_codes_) {  // add all symbols with their codes to the Huffman tree
-            huffman_tree.AddSymbol(symbol, code);
-        }
+bool Decoder::DecodeMember() {
+    Reset();
 
-        files_ended = DecodeFile(huffman_tree);
+    ReadCodeTable(bin_in_, max_code_length_, symbols_, length_counts_);
+
+    if (format_version_ != LEGACY_FORMAT && block_size_ == 0) {
+        file_size_ = bin_in_.Read(BITS_IN_FILE_SIZE);
     }
+
+    decode_table_.Build(symbols_, length_counts_, bin_in_.GetBitOrder());
+
+    return DecodeFile();
 }
 
-Symbol Decoder::GetNextSymbol(HuffmanTree& huffman_tree) {
-    Symbol symbol = huffman_tree.GetNextSymbol(bin_in_);
-    return symbol;
+Symbol Decoder::GetNextSymbol() {
+    return decode_table_.Decode(bin_in_);
 }
 
-bool Decoder::DecodeFile(HuffmanTree& huffman_tree) {
-    Symbol symbol = GetNextSymbol(huffman_tree);
+bool Decoder::DecodeFile() {
+    Symbol symbol = GetNextSymbol();
 
     std::string file_name;
 
     while (symbol != FILENAME_END) {
+        CheckOverrun();
         char c = static_cast<char>(symbol.to_ullong());
         file_name += c;
-        symbol = GetNextSymbol(huffman_tree);
+        symbol = GetNextSymbol();
     }
 
-    std::ofstream out(file_name, std::ios::binary);
-    symbol = GetNextSymbol(huffman_tree);
-
-    while (symbol != ONE_MORE_FILE && symbol != ARCHIVE_END) {
-        char c = static_cast<char>(symbol.to_ullong());
-        out.put(c);
-        symbol = GetNextSymbol(huffman_tree);
+    auto out = CreateOutputFile(file_name, options_);
+    if (file_size_) {
+        out->Preallocate(*file_size_);
+    }
+    symbol = block_size_ > 0 ? DecodeBlocks(*out) : DecodeStream(*out);
+    out->Close();
+    if (!member_only_) {
+        std::cout << "Decoded file " << file_name << std::endl;
     }
-    out.close();
-    std::cout << "Decoded file " << file_name << std::endl;
     return symbol == ARCHIVE_END;
 }
-}  // namespace Huffman
\ No newline at end of file
+
+Symbol Decoder::DecodeStream(ByteSink& out) {
+    auto buffer = out.GetBuffer(DecodeTable::MAX_RUN);
+    size_t buffer_pos = 0;
+    uint64_t written = 0;
+    uint64_t preallocated = file_size_ ? UINT64_MAX : 0;
+    Symbol symbol;
+
+    while (true) {
+        if (buffer.size() - buffer_pos < DecodeTable::MAX_RUN) {
+            CheckOverrun();  // once per buffer, the symbols are decoded without checking the end of the archive
+            out.Commit(buffer_pos);
+            written += buffer_pos;
+            if (written >= preallocated) {  // the file size is unknown, it is preallocated in growing extents
+                uint64_t extent = std::max(written, MIN_PREALLOCATION);
+                out.Preallocate(extent);
+                preallocated = written + extent;
+            }
+            buffer = out.GetBuffer(DecodeTable::MAX_RUN);
+            buffer_pos = 0;
+        }
+        const auto& run = decode_table_.LookupRun(bin_in_);
+        if (run.count > 0) {  // all MAX_RUN bytes are copied, only count of them are kept
+            std::memcpy(buffer.data() + buffer_pos, run.bytes.data(), run.bytes.size());
+            buffer_pos += run.count;
+            bin_in_.Skip(run.len);
+            continue;
+        }
+        symbol = GetNextSymbol();
+        if (symbol == ONE_MORE_FILE || symbol == ARCHIVE_END) {
+            break;
+        }
+        buffer[buffer_pos++] = static_cast<char>(symbol.to_ullong());
+    }
+    CheckOverrun();
+    out.Commit(buffer_pos);
+    return symbol;
+}
+
+Symbol Decoder::DecodeBlocks(ByteSink& out) {
+    uint64_t written = 0;
+    uint64_t preallocated = 0;
+    while (true) {
+        bin_in_.AlignToByte();
+        size_t size = bin_in_.Read(BITS_IN_BLOCK_SIZE);
+        if (size == 0) {
+            break;
+        }
+        if (size > block_size_) {
+            throw std::runtime_error("Error: The file is invalid, a block is longer than the block size");
+        }
+        block_data_.resize(bin_in_.Read(BITS_IN_BLOCK_SIZE));
+        bin_in_.ReadBytes(block_data_);
+        CheckOverrun();
+        if (written + size > preallocated) {  // the file size is unknown, it is preallocated in growing extents
+            uint64_t extent = std::max({written, MIN_PREALLOCATION, uint64_t(size)});
+            out.Preallocate(extent);
+            preallocated = written + extent;
+        }
+        block_decoder_->Decode(block_data_, size, out);
+        written += size;
+    }
+    return ReadMemberEnd();
+}
+
+Symbol Decoder::ReadMemberEnd() {
+    Symbol symbol = GetNextSymbol();
+    CheckOverrun();
+    if (symbol != ONE_MORE_FILE && symbol != ARCHIVE_END) {
+        throw std::runtime_error("Error: The file is invalid, the file is longer than its size");
+    }
+    return symbol;
+}
+
+void Decoder::DecodeIndexed(std::span<const char> archive) {
+    auto index = ReadIndex(archive);
+    // the file names are decoded here, the bodies by the jobs
+    std::vector<std::string> file_names;
+    std::deque<OutputFile> files;  // opened by their first decoded blocks, so that few of them are open at once
+    std::vector<DecodeJob> jobs;
+    for (const auto& member : index) {
+        auto data = archive.subspan(member.offset);
+        file_names.emplace_back(ReadFileName(data));
+        if (block_size_ == 0) {
+            jobs.push_back({data});
+            continue;
+        }
+        if (member.blocks.size() != (member.file_size + block_size_ - 1) / block_size_) {
+            throw std::runtime_error("Error: The file is invalid, the index has a wrong number of blocks");
+        }
+        if (member.blocks.empty()) {  // an empty file has no blocks to create it
+            PositionalFile(file_names.back(), 0).Close();
+            continue;
+        }
+        auto& file = files.emplace_back();
+        file.name = file_names.back();
+        file.size = member.file_size;
+        file.blocks_left = member.blocks.size();
+        for (size_t block = 0; block < member.blocks.size(); ++block) {
+            uint64_t file_offset = block * block_size_;
+            size_t size = std::min<uint64_t>(block_size_, member.file_size - file_offset);
+            jobs.push_back({archive.subspan(member.blocks[block]), &file, file_offset, size});
+        }
+    }
+
+    if (!pool_) {
+        pool_ = std::make_unique<ThreadPool>(options_.threads);
+    }
+    std::atomic<size_t> next_job = 0;  // the jobs are taken in order, so the files are written mostly sequentially
+    std::vector<std::future<void>> workers;
+    for (size_t worker = 0; worker < pool_->Size(); ++worker) {
+        workers.emplace_back(pool_->Submit([&] {
+            BlockDecoder decoder(max_code_length_);
+            std::vector<char> buffer;
+            try {
+                for (size_t job = next_job++; job < jobs.size(); job = next_job++) {
+                    if (jobs[job].file) {
+                        DecodeBlock(jobs[job], decoder, buffer);
+                    } else {
+                        Decoder(jobs[job].data, *this).DecodeMember();
+                    }
+                }
+            } catch (...) {  // the other workers stop after their current jobs
+                next_job = jobs.size();
+                throw;
+            }
+        }));
+    }
+    for (auto& worker : workers) {
+        worker.wait();
+    }
+    for (auto& worker : workers) {
+        worker.get();
+    }
+    for (const auto& file_name : file_names) {
+        std::cout << "Decoded file " << file_name << std::endl;
+    }
+}
+
+std::vector<MemberIndex> Decoder::ReadIndex(std::span<const char> archive) const {
+    const size_t entry_size = BITS_IN_INDEX_ENTRY / BITS_IN_BYTE;
+    if (archive.size() < entry_size) {
+        throw std::runtime_error("Error: unexpected end of file");
+    }
+    MemorySource offset_source(archive.last(entry_size));
+    uint64_t index_offset = BitReader(offset_source, BitOrder::LsbFirst).Read(BITS_IN_INDEX_ENTRY);
+    if (index_offset > archive.size() - entry_size) {
+        throw std::runtime_error("Error: The file is invalid, the index is out of the archive");
+    }
+    auto index_data = archive.subspan(index_offset, archive.size() - entry_size - index_offset);
+    MemorySource source(index_data);
+    BitReader in(source, BitOrder::LsbFirst);
+    auto read_count = [&] {  // of the entries which follow, each of them takes entry_size bytes
+        uint64_t count = in.Read(BITS_IN_INDEX_ENTRY);
+        if (count > index_data.size() / entry_size) {
+            throw std::runtime_error("Error: The file is invalid, the index is too short");
+        }
+        return count;
+    };
+    std::vector<MemberIndex> index(read_count());
+    for (auto& member : index) {
+        member.offset = in.Read(BITS_IN_INDEX_ENTRY);
+        member.file_size = in.Read(BITS_IN_INDEX_ENTRY);
+        member.blocks.resize(read_count());
+        for (auto& block : member.blocks) {
+            block = in.Read(BITS_IN_INDEX_ENTRY);
+            if (block >= index_offset) {
+                throw std::runtime_error("Error: The file is invalid, a block is out of the archive");
+            }
+        }
+        if (member.offset >= index_offset) {
+            throw std::runtime_error("Error: The file is invalid, a member is out of the archive");
+        }
+    }
+    return index;
+}
+
+std::string Decoder::ReadFileName(std::span<const char> member) {
+    MemorySource source(member);
+    BitReader in(source, StreamBitOrder(format_version_));
+    ReadCodeTable(in, max_code_length_, symbols_, length_counts_);
+    if (format_version_ != LEGACY_FORMAT && block_size_ == 0) {
+        in.Read(BITS_IN_FILE_SIZE);  // the index has the file size
+    }
+    decode_table_.Build(symbols_, length_counts_, in.GetBitOrder());
+    std::string file_name;
+    for (Symbol symbol = decode_table_.Decode(in); symbol != FILENAME_END; symbol = decode_table_.Decode(in)) {
+        if (in.Status() == ReadStatus::Overrun) {
+            throw std::runtime_error("Error: unexpected end of file");
+        }
+        file_name += static_cast<char>(symbol.to_ullong());
+    }
+    return file_name;
+}
+
+void Decoder::DecodeBlock(const DecodeJob& job, BlockDecoder& decoder, std::vector<char>& buffer) const {
+    const size_t header_size = 2 * BITS_IN_BLOCK_SIZE / BITS_IN_BYTE;
+    MemorySource source(job.data.first(std::min(job.data.size(), header_size)));
+    BitReader in(source, BitOrder::LsbFirst);
+    size_t size = in.Read(BITS_IN_BLOCK_SIZE);
+    size_t encoded_size = in.Read(BITS_IN_BLOCK_SIZE);
+    if (encoded_size > job.data.size() - header_size) {
+        throw std::runtime_error("Error: unexpected end of file");
+    }
+    if (size != job.size) {
+        throw std::runtime_error("Error: The file is invalid, a block does not match the index");
+    }
+    buffer.resize(size + DecodeTable::MAX_RUN);  // the decoder asks for a few spare bytes
+    MemorySink sink(buffer);
+    decoder.Decode(job.data.subspan(header_size, encoded_size), size, sink);
+    auto& output = *job.file;
+    PositionalFile* file = nullptr;
+    {
+        std::lock_guard lock(output.mutex);
+        if (!output.file) {
+            output.file = std::make_unique<PositionalFile>(output.name, output.size);
+        }
+        file = output.file.get();
+    }
+    file->WriteAt(std::span<const char>(buffer).first(size), job.file_offset);
+    if (--output.blocks_left == 0) {  // the last block closes the file
+        std::lock_guard lock(output.mutex);
+        output.file.reset();
+    }
+}
+}  // namespace Huffman
@@ -1,30 +1,149 @@
 #pragma once
 
+#include <atomic>
+#include <deque>
 #include <fstream>
-#include <unordered_map>
+#include <future>
+#include <mutex>
+#include <optional>
 
+#include "AsyncIO.h"
 #include "BitIO.h"
+#include "BodyCodec.h"
+#include "CanonicalCodes.h"
+#include "DecodeTable.h"
 #include "HuffmanTree.h"
+#include "ThreadPool.h"
 
 namespace Huffman {
+// An archive of the legacy format starts with the first member straight away and packs bits BitOrder::MsbFirst. Newer
+// archives start with a zero byte and the format version byte, which the legacy format can not start with, pack bits
+// BitOrder::LsbFirst and store the size of each file after its code lengths. Since version 2 the version byte is
+// followed by the code length limit byte. Since version 3 it is followed by the streams count byte, which is always 1:
+// several interleaved streams did not decode faster than one. Since version 4 it is followed by the 32-bit block size:
+// if it is not zero, the codes of a member are only for its file name and the special symbols, there is no file size,
+// and the file body is split into blocks of this size with their own codes of bytes. Each block starts at a byte
+// boundary with its 32-bit size and the 32-bit size of its encoded data in bytes, the data has the code table and the
+// codes of the block in the layout of a body, see BodyCodec.h. A block of size zero ends the body. Since version 5 each
+// member after the first one starts at a byte boundary, so that the members can be encoded separately and copied into
+// the archive as they are. Since version 6 the archive ends with an index at a byte boundary after ARCHIVE_END, so that
+// the members and the blocks are decoded in parallel: the 64-bit number of members, then for each member the 64-bit
+// byte offset of the member, the 64-bit size of its file, the 64-bit number of its blocks and the 64-bit byte offset of
+// each block; the last 64 bits are the byte offset of the index.
+const uint8_t LEGACY_FORMAT = 0;
+const uint8_t FORMAT_VERSION = 6;
+const uint8_t CODE_LENGTH_LIMIT_VERSION = 2;
+const uint8_t STREAMS_VERSION = 3;
+const uint8_t BLOCKS_VERSION = 4;
+const uint8_t ALIGNED_MEMBERS_VERSION = 5;
+const uint8_t INDEX_VERSION = 6;
+
+const size_t MIN_CODE_LENGTH_LIMIT = 9;  // enough for all the symbols
+const size_t MAX_CODE_LENGTH_LIMIT = 64;
+const size_t DEFAULT_CODE_LENGTH_LIMIT = 11;  // every code is decoded with one lookup
+
+const size_t MIN_BLOCK_SIZE = 64 << 10;
+const size_t MAX_BLOCK_SIZE = 256 << 20;
+const size_t DEFAULT_BLOCK_SIZE = 1 << 20;
+
+const size_t DEFAULT_READ_BUFFER_LIMIT = 256 << 20;
+const size_t DEFAULT_MEMBER_BUFFER_LIMIT = 1 << 20;
+
+struct Options {
+    std::shared_ptr<AsyncIoBackend> io_backend;  // if set, files are read and written asynchronously
+    uint8_t format_version = FORMAT_VERSION;     // of the written archives, LEGACY_FORMAT or FORMAT_VERSION
+    size_t max_code_length = DEFAULT_CODE_LENGTH_LIMIT;
+    size_t block_size = DEFAULT_BLOCK_SIZE;  // zero for one code of the whole file, the legacy format has no blocks
+    size_t threads = 0;  // that encode or decode the blocks and the members, zero for all the cores
+    // without blocks the files up to this size which are not mapped or in memory already are read once, the mapped
+    // and the longer ones are read twice; the blocks are always read once
+    size_t read_buffer_limit = DEFAULT_READ_BUFFER_LIMIT;
+    // Coder::AddFiles() encodes the files shorter than this and than a block concurrently into their own buffers, the
+    // other files are encoded one by one with their blocks in parallel
+    size_t member_buffer_limit = DEFAULT_MEMBER_BUFFER_LIMIT;
+};
+
+struct MemberIndex {  // an entry of the archive index, the offsets are in bytes from the start of the archive
+    uint64_t offset = 0;
+    uint64_t file_size = 0;
+    std::vector<uint64_t> blocks;  // the offsets of the blocks
+};
+
 class Coder {
 public:
     explicit Coder(std::ofstream& out);
+    explicit Coder(std::unique_ptr<ByteSink> sink, Options options = {});
+    explicit Coder(ByteSink& sink, Options options = {});
     void AddFile(const std::string& file_name);
+    // without blocks the source is read twice if it is in memory or longer than Options::read_buffer_limit
+    void AddFile(const std::string& file_name, ByteSource& source);
+    // the same archive as AddFile() for each of the files, but the small members are encoded concurrently into their
+    // own buffers, see Options::member_buffer_limit; a member is kept in memory until the previous ones are added
+    void AddFiles(const std::vector<std::string>& file_names);
+    // the size of the last added member, known as soon as its canonical codes are built; it is exact without blocks,
+    // with blocks it is known once AddFile() returns and it may take less because of the alignment of the blocks; the
+    // alignment of the next member is not counted
+    [[nodiscard]] uint64_t MemberBits(bool last_member) const;
+    // the size of the index which Close() writes after the alignment of ARCHIVE_END, zero if there is no index
+    [[nodiscard]] uint64_t IndexBits() const;
+    void Close();
     ~Coder();
 
 private:
+    struct MemberOnly {};
+    Coder(ByteSink& sink, Options options, MemberOnly);  // writes a member without the archive header and ending
+
     void Reset();
-    void MakeCanonicalCodes(std::unordered_map<Symbol, size_t>& symbol_freq);
-    void MakeCanonicalCodes(std::vector<std::pair<Symbol, size_t>>& code_length_per_symbol);
-    void Encode(const std::string& file_name);
-    void Write(const Symbol& symbol);
+    void StartMember();  // ends the previous member
+    void WriteArchiveHeader();
+    [[nodiscard]] uint64_t CountMemberBits(const SymbolFreqs& symbol_freq) const;
+    void Encode(const std::string& file_name, ByteSource& source);
+    void EncodeBlocks(ByteSource& source);
+    [[nodiscard]] size_t BlockSize() const;
+    void WriteCode(const Symbol& symbol);
 
 private:
+    struct BlockJob {  // a block encoded on the thread pool
+        std::vector<char> data;       // a copy of the block if the source is not in memory
+        std::span<const char> bytes;  // of the block, in data or in the source
+        std::unique_ptr<BlockEncoder> encoder;
+        std::span<const char> encoded;
+        std::future<void> done;
+    };
+
+    BlockJob NewBlockJob();
+    void SubmitBlock(BlockJob job);
+    void WriteBlock();  // the first of blocks_ once it is encoded
+
+    struct MemberJob {  // a member encoded on the thread pool
+        std::unique_ptr<VectorSink> sink;
+        std::unique_ptr<Coder> coder;  // writes to the sink, keeps its buffers for the next members
+        uint64_t bits = 0;             // of the member in the sink
+        std::future<void> done;
+    };
+
+    [[nodiscard]] bool IsSmallFile(const std::string& file_name) const;
+    MemberJob NewMemberJob();
+    void SubmitMember(std::deque<MemberJob>& members, const std::string& file_name);
+    void WriteMember(MemberJob& member);
+
+    [[nodiscard]] bool HasIndex() const;
+    void WriteIndex();
+
+    Options options_;
     BitWriter bin_out_;
-    std::vector<Symbol> symbols_ordered_by_codes_;
-    std::unordered_map<Symbol, Code> canonical_codes_;
+    CanonicalCodes canonical_codes_;
+    std::vector<char> file_buffer_;   // the whole input file if it is read only once
+    std::deque<BlockJob> blocks_;  // submitted in the order of the file
+    std::vector<BlockJob> spare_blocks_;
+    std::vector<MemberJob> spare_members_;
+    std::vector<MemberIndex> index_;  // a member-only Coder keeps the offsets in its writer
+    std::unique_ptr<ThreadPool> pool_;  // destroyed first, so that the tasks do not outlive the blocks
+    uint64_t file_size_ = 0;
+    uint64_t member_bits_ = 0;  // without the ONE_MORE_FILE or ARCHIVE_END at the end
     bool first_file_ = true;
+    bool closed_ = false;
+    bool member_only_ = false;
     constexpr static const Symbol FILENAME_END = 256;
     constexpr static const Symbol ONE_MORE_FILE = 257;
     constexpr static const Symbol ARCHIVE_END = 258;
@@ -33,19 +152,59 @@ private:
 class Decoder {
 public:
     explicit Decoder(std::ifstream& in);
+    explicit Decoder(const std::string& archive_name, Options options = {});
+    explicit Decoder(std::unique_ptr<ByteSource> source, Options options = {});
+    // an archive with an index from a source in memory is decoded on Options::threads threads, each of them writes
+    // the decoded members and blocks to their places in the files
     void Decode();
-    Symbol GetNextSymbol(HuffmanTree& huffman_tree);
+    Symbol GetNextSymbol();
 
 private:
+    Decoder(std::span<const char> member, const Decoder& archive);  // decodes a member of the archive
+
+    struct OutputFile {  // of a member with blocks, it is open only while its blocks are decoded
+        std::string name;
+        uint64_t size = 0;
+        std::atomic<size_t> blocks_left = 0;
+        std::mutex mutex;
+        std::unique_ptr<PositionalFile> file;
+    };
+
+    struct DecodeJob {  // a member or a block decoded on the thread pool
+        std::span<const char> data;  // from the start of the member or the block to the end of the archive
+        OutputFile* file = nullptr;  // of the block, the member creates its file itself
+        uint64_t file_offset = 0;        // of the block
+        size_t size = 0;                 // of the block
+    };
+
     void Reset();
-    size_t ReadAmount();
-    bool DecodeFile(HuffmanTree& huffman_tree);
+    void ReadArchiveHeader();
+    void CheckOverrun() const;
+    bool DecodeMember();
+    bool DecodeFile();
+    Symbol DecodeStream(ByteSink& out);
+    Symbol DecodeBlocks(ByteSink& out);
+    Symbol ReadMemberEnd();  // the symbol after the file body
+    void DecodeIndexed(std::span<const char> archive);
+    [[nodiscard]] std::vector<MemberIndex> ReadIndex(std::span<const char> archive) const;
+    std::string ReadFileName(std::span<const char> member);
+    void DecodeBlock(const DecodeJob& job, BlockDecoder& decoder, std::vector<char>& buffer) const;
 
 private:
+    Options options_;
+    std::unique_ptr<ByteSource> source_;
     BitReader bin_in_;
-    size_t symbols_count_;
+    uint8_t format_version_ = LEGACY_FORMAT;
+    size_t max_code_length_ = MAX_CODE_LENGTH_LIMIT;
+    size_t block_size_ = 0;
+    std::vector<char> block_data_;
+    std::optional<BlockDecoder> block_decoder_;
+    std::optional<uint64_t> file_size_;
     std::vector<Symbol> symbols_;
-    std::unordered_map<Code, Symbol> canonical_codes_;
+    std::vector<size_t> length_counts_;  // indexed by code lengths
+    DecodeTable decode_table_;
+    std::unique_ptr<ThreadPool> pool_;
+    bool member_only_ = false;
     constexpr static const Symbol FILENAME_END = 256;
     constexpr static const Symbol ONE_MORE_FILE = 257;
     constexpr static const Symbol ARCHIVE_END = 258;
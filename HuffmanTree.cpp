@@ -1,103 +1,83 @@
 #include "HuffmanTree.h"
 
-namespace Huffman {
-HuffmanTree::Node::Node(Symbol symbol) : symbol(symbol) {
-}
+#include <stdexcept>
 
-HuffmanTree::HuffmanTree() {
-    root_ = new Node(INCORRECT_SYMBOL);
+namespace Huffman {
+HuffmanTree::NodeIndex HuffmanTree::AddNode(Node node) {
+    if (nodes_.size() == NO_NODE) {
+        throw std::runtime_error("Error: too many nodes in the Huffman Tree");
+    }
+    nodes_.emplace_back(node);
+    return nodes_.size() - 1;
 }
 
-HuffmanTree::HuffmanTree(Symbol symbol) {
-    root_ = new Node(symbol);
+HuffmanTree::NodeIndex HuffmanTree::AddLeaf(Symbol symbol) {
+    NodeIndex leaf = AddNode({static_cast<uint16_t>(symbol.to_ulong())});
+    if (root_ == NO_NODE) {
+        root_ = leaf;
+    }
+    return leaf;
 }
 
-HuffmanTree* HuffmanTree::Merge(HuffmanTree& left, HuffmanTree& right) {
-    auto* new_tree = new HuffmanTree(INCORRECT_SYMBOL);
-    new_tree->root_->left = left.root_;
-    new_tree->root_->right = right.root_;
-    return new_tree;
+HuffmanTree::NodeIndex HuffmanTree::AddInternalNode(NodeIndex left, NodeIndex right) {
+    root_ = AddNode({static_cast<uint16_t>(INCORRECT_SYMBOL.to_ulong()), left, right});
+    return root_;
 }
 
 std::vector<std::pair<Symbol, size_t>> HuffmanTree::GetCodeLengthsForSymbols() const {
-    std::vector<std::pair<Symbol, size_t>> codes_for_symbols;
-    Dfs(root_, codes_for_symbols, 0);
-    return codes_for_symbols;
-}
-
-void HuffmanTree::Dfs(Node* node, std::vector<std::pair<Symbol, size_t>>& code_lengths, size_t depth) {
-    if (node == nullptr) {
-        return;
-    }
-    if (node->left == nullptr && node->right == nullptr) {
-        code_lengths.emplace_back(node->symbol, depth);
+    std::vector<std::pair<Symbol, size_t>> code_lengths;
+    if (root_ == NO_NODE) {
+        return code_lengths;
     }
-    Dfs(node->left, code_lengths, depth + 1);
-    Dfs(node->right, code_lengths, depth + 1);
-}
-
-void HuffmanTree::AddSymbol(Symbol symbol, Code code) {
-    std::reverse(code.begin(), code.end());
-    AddSymbol(root_, symbol, code);
-}
-
-void HuffmanTree::AddSymbol(Node* node, Symbol symbol, Code& code) {
-    if (code.empty()) {
-        if (node->symbol != INCORRECT_SYMBOL) {
-            throw std::runtime_error("Error: Failed to add a symbol to the Huffman Tree");
+    std::vector<std::pair<NodeIndex, size_t>> stack = {{root_, 0}};  // nodes with their depths
+    while (!stack.empty()) {
+        auto [index, depth] = stack.back();
+        stack.pop_back();
+        const auto& node = nodes_[index];
+        if (node.left == NO_NODE && node.right == NO_NODE) {
+            code_lengths.emplace_back(node.symbol, depth);
+            continue;
         }
-        node->symbol = symbol;
-        return;
-    }
-    bool bit = code.back();
-    code.pop_back();
-    if (bit == 0) {
-        if (node->left == nullptr) {
-            node->left = new Node(INCORRECT_SYMBOL);
+        if (node.right != NO_NODE) {
+            stack.emplace_back(node.right, depth + 1);
         }
-        AddSymbol(node->left, symbol, code);
-    } else {
-        if (node->right == nullptr) {
-            node->right = new Node(INCORRECT_SYMBOL);
+        if (node.left != NO_NODE) {
+            stack.emplace_back(node.left, depth + 1);
         }
-        AddSymbol(node->right, symbol, code);
-    }
-}
-
-Symbol HuffmanTree::GetNextSymbol(BitReader& bin_in) {
-    Symbol res = HuffmanTree::GetNextSymbol(root_, bin_in);
-    if (res == INCORRECT_SYMBOL) {
-        throw std::runtime_error("Error: The file is invalid, unable to find the symbol for encoded data");
     }
-    return res;
+    return code_lengths;
 }
 
-Symbol HuffmanTree::GetNextSymbol(Node* node, BitReader& bin_in) {
-    if (node == nullptr) {
-        return INCORRECT_SYMBOL;
+void HuffmanTree::AddSymbol(Symbol symbol, const Code& code) {
+    if (root_ == NO_NODE) {
+        root_ = AddNode({static_cast<uint16_t>(INCORRECT_SYMBOL.to_ulong())});
     }
-    if (node->symbol != INCORRECT_SYMBOL) {
-        return node->symbol;
+    NodeIndex index = root_;
+    for (bool bit : code) {
+        NodeIndex child = bit ? nodes_[index].right : nodes_[index].left;
+        if (child == NO_NODE) {
+            child = AddNode({static_cast<uint16_t>(INCORRECT_SYMBOL.to_ulong())});  // nodes_ may be reallocated
+            (bit ? nodes_[index].right : nodes_[index].left) = child;
+        }
+        index = child;
     }
-    auto bit = bin_in.Get();
-    if (bit == 0) {
-        return GetNextSymbol(node->left, bin_in);
-    } else {
-        return GetNextSymbol(node->right, bin_in);
+    if (nodes_[index].symbol != INCORRECT_SYMBOL) {
+        throw std::runtime_error("Error: Failed to add a symbol to the Huffman Tree");
     }
+    nodes_[index].symbol = symbol.to_ulong();
 }
 
-void HuffmanTree::Delete(HuffmanTree::Node* node) {
-    if (node == nullptr) {
-        return;
+Symbol HuffmanTree::GetNextSymbol(BitReader& bin_in) const {
+    // the end of the stream is not checked here, the bits after it are zeroes and the caller checks bin_in.Status()
+    NodeIndex index = root_;
+    while (index != NO_NODE && nodes_[index].symbol == INCORRECT_SYMBOL) {
+        auto bit = bin_in.Peek(1);
+        bin_in.Skip(1);
+        index = bit == 0 ? nodes_[index].left : nodes_[index].right;
     }
-    Delete(node->left);
-    Delete(node->right);
-    delete node;
-}
-
-HuffmanTree::~HuffmanTree() {
-    Delete(root_);
+    if (index == NO_NODE) {
+        throw std::runtime_error("Error: The file is invalid, unable to find the symbol for encoded data");
+    }
+    return nodes_[index].symbol;
 }
-
-}  // namespace Huffman
\ No newline at end of file
+}  // namespace Huffman
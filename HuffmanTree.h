@@ -11,31 +11,32 @@ const size_t BITS_IN_SYMBOL = 9;
 using Symbol = std::bitset<BITS_IN_SYMBOL>;
 using Code = std::vector<bool>;
 
+// The nodes are stored in one array and refer to their children by indices
 class HuffmanTree {
 public:
-    HuffmanTree();
-    explicit HuffmanTree(Symbol symbol);
-    static HuffmanTree* Merge(HuffmanTree& left, HuffmanTree& right);
+    using NodeIndex = uint16_t;
+
+    HuffmanTree() = default;
+    NodeIndex AddLeaf(Symbol symbol);                         // the first added node is the root until a merge
+    NodeIndex AddInternalNode(NodeIndex left, NodeIndex right);  // becomes the root
     [[nodiscard]] std::vector<std::pair<Symbol, size_t>> GetCodeLengthsForSymbols() const;
-    void AddSymbol(Symbol symbol, Code code);
-    Symbol GetNextSymbol(BitReader& bin_in);
-    ~HuffmanTree();
+    void AddSymbol(Symbol symbol, const Code& code);
+    Symbol GetNextSymbol(BitReader& bin_in) const;
 
 private:
+    constexpr static const NodeIndex NO_NODE = UINT16_MAX;
+
     struct Node {
-        explicit Node(Symbol symbol);
-        Symbol symbol = 0;
-        Node* left = nullptr;
-        Node* right = nullptr;
+        uint16_t symbol;
+        NodeIndex left = NO_NODE;
+        NodeIndex right = NO_NODE;
     };
 
     constexpr static const Symbol INCORRECT_SYMBOL = 0b111'111'111;
-    static void Dfs(Node* node, std::vector<std::pair<Symbol, size_t>>& code_lengths, size_t depth);
-    void AddSymbol(Node* node, Symbol symbol, Code& code);
-    static Symbol GetNextSymbol(Node* node, BitReader& bin_in);
-    static void Delete(Node* node);
+    NodeIndex AddNode(Node node);
 
 private:
-    Node* root_ = nullptr;
+    std::vector<Node> nodes_;
+    NodeIndex root_ = NO_NODE;
 };
-}  // namespace Huffman
\ No newline at end of file
+}  // namespace Huffman
@@ -1,137 +1,221 @@
 #pragma once
 
+#include <cstdint>
 #include <functional>
+#include <memory>
 #include <stdexcept>
+#include <utility>
+#include <vector>
 
-template <class T, class Compare = std::less<T>>
+// The nodes are kept in one vector and linked by 32-bit indices. The nodes of the extracted values are reused by the
+// next inserts, and Clear() keeps the memory, so a heap reused for many small builds allocates only while it grows.
+template <class T, class Compare = std::less<T>, class Allocator = std::allocator<T>>
 class LeftistHeap {
 public:
     LeftistHeap() = default;
+    explicit LeftistHeap(const Allocator& allocator);
     explicit LeftistHeap(const T& value);
     explicit LeftistHeap(const std::vector<T>& values);
+    // replaces the values, builds the heap bottom-up in O(n); std::make_move_iterator moves the values in
+    template <class Iterator>
+    void Assign(Iterator first, Iterator last);
+    template <class... Args>
+    void Emplace(Args&&... args);
     void Insert(const T& value);
-    T Extract();
-    T Top();
+    void Insert(T&& value);
+    T Extract();  // moves the value out
+    [[nodiscard]] const T& Top() const;
     [[nodiscard]] bool Empty() const;
     [[nodiscard]] size_t Size() const;
-    ~LeftistHeap();
+    void Clear();  // keeps the memory of the nodes
 
 private:
+    using NodeIndex = uint32_t;
+    constexpr static const NodeIndex NIL = UINT32_MAX;
+
     struct Node {
-        explicit Node(const T& value);
-        static size_t Dist(Node* v);
+        template <class... Args>
+        explicit Node(Args&&... args);
         T val;
-        Node* left = nullptr;
-        Node* right = nullptr;
-        size_t dist = 0;
+        NodeIndex left = NIL;
+        NodeIndex right = NIL;  // the next free node for the free nodes
+        uint32_t dist = 1;
     };
-
-    static Node* Merge(Node* x, Node* y);
-    static void Delete(Node* node);
-
-    Node* root_ = nullptr;
+    using NodeAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Node>;
+    using IndexAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<NodeIndex>;
+
+    uint32_t Dist(NodeIndex v) const;
+    template <class... Args>
+    NodeIndex NewNode(Args&&... args);
+    NodeIndex Merge(NodeIndex x, NodeIndex y);
+
+    std::vector<Node, NodeAllocator> nodes_;
+    std::vector<NodeIndex, IndexAllocator> roots_;  // the heaps merged by Assign()
+    std::vector<NodeIndex, IndexAllocator> path_;   // the right spine built by Merge()
+    NodeIndex root_ = NIL;
+    NodeIndex free_ = NIL;  // the list of the nodes of the extracted values
     size_t size_ = 0;
 };
 
-template <class T, class Compare>
-LeftistHeap<T, Compare>::Node::Node(const T& value) : val(value) {
-    dist = 1;
+template <class T, class Compare, class Allocator>
+template <class... Args>
+LeftistHeap<T, Compare, Allocator>::Node::Node(Args&&... args) : val(std::forward<Args>(args)...) {
 }
 
-template <class T, class Compare>
-size_t LeftistHeap<T, Compare>::Node::Dist(LeftistHeap::Node* v) {
-    return v == nullptr ? 0 : v->dist;
+template <class T, class Compare, class Allocator>
+LeftistHeap<T, Compare, Allocator>::LeftistHeap(const Allocator& allocator)
+    : nodes_(NodeAllocator(allocator)), roots_(IndexAllocator(allocator)), path_(IndexAllocator(allocator)) {
 }
 
-template <class T, class Compare>
-LeftistHeap<T, Compare>::LeftistHeap(const T& value) {
-    root_ = new Node(value);
-    size_ = 1;
+template <class T, class Compare, class Allocator>
+LeftistHeap<T, Compare, Allocator>::LeftistHeap(const T& value) {
+    Insert(value);
 }
 
-template <class T, class Compare>
-LeftistHeap<T, Compare>::LeftistHeap(const std::vector<T>& values) {
-    *this = LeftistHeap();
-    for (const auto& x : values) {
-        this->Insert(x);
+template <class T, class Compare, class Allocator>
+LeftistHeap<T, Compare, Allocator>::LeftistHeap(const std::vector<T>& values) {
+    Assign(values.begin(), values.end());
+}
+
+template <class T, class Compare, class Allocator>
+uint32_t LeftistHeap<T, Compare, Allocator>::Dist(NodeIndex v) const {
+    return v == NIL ? 0 : nodes_[v].dist;
+}
+
+template <class T, class Compare, class Allocator>
+template <class... Args>
+typename LeftistHeap<T, Compare, Allocator>::NodeIndex LeftistHeap<T, Compare, Allocator>::NewNode(Args&&... args) {
+    if (free_ == NIL) {
+        if (nodes_.size() == NIL) {
+            throw std::runtime_error("Error: Too many values in a heap");
+        }
+        nodes_.emplace_back(std::forward<Args>(args)...);
+        return nodes_.size() - 1;
     }
+    NodeIndex v = free_;
+    free_ = nodes_[v].right;
+    nodes_[v].val = T(std::forward<Args>(args)...);
+    nodes_[v].left = NIL;
+    nodes_[v].right = NIL;
+    nodes_[v].dist = 1;
+    return v;
 }
 
-template <class T, class Compare>
-typename LeftistHeap<T, Compare>::Node* LeftistHeap<T, Compare>::Merge(LeftistHeap::Node* x, LeftistHeap::Node* y) {
-    if (x == nullptr) {
+template <class T, class Compare, class Allocator>
+typename LeftistHeap<T, Compare, Allocator>::NodeIndex LeftistHeap<T, Compare, Allocator>::Merge(NodeIndex x,
+                                                                                                 NodeIndex y) {
+    if (x == NIL) {
         return y;
     }
-    if (y == nullptr) {
+    if (y == NIL) {
         return x;
     }
-    if (Compare()(y->val, x->val)) {
+    if (Compare()(nodes_[y].val, nodes_[x].val)) {
         std::swap(x, y);
     }
-    x->right = Merge(x->right, y);
-    if (Node::Dist(x->right) > Node::Dist(x->left)) {
-        std::swap(x->left, x->right);
+    NodeIndex root = x;
+    // the right spines are merged top-down: x is the last node of the merged spine and y the rest of the other heap
+    path_.clear();
+    while (true) {
+        path_.emplace_back(x);
+        NodeIndex right = nodes_[x].right;
+        if (right == NIL) {
+            nodes_[x].right = y;
+            break;
+        }
+        if (Compare()(nodes_[y].val, nodes_[right].val)) {
+            nodes_[x].right = y;
+            y = right;
+        }
+        x = nodes_[x].right;
+    }
+    // then the distances are fixed bottom-up
+    for (auto v = path_.rbegin(); v != path_.rend(); ++v) {
+        auto& node = nodes_[*v];
+        if (Dist(node.right) > Dist(node.left)) {
+            std::swap(node.left, node.right);
+        }
+        node.dist = Dist(node.right) + 1;
     }
-    x->dist = Node::Dist(x->right) + 1;
-    return x;
+    return root;
 }
 
-template <class T, class Compare>
-void LeftistHeap<T, Compare>::Insert(const T& value) {
-    auto* new_heap = new LeftistHeap<T, Compare>(value);
-    root_ = Merge(new_heap->root_, root_);
-    size_ += new_heap->size_;
+template <class T, class Compare, class Allocator>
+template <class Iterator>
+void LeftistHeap<T, Compare, Allocator>::Assign(Iterator first, Iterator last) {
+    Clear();
+    for (; first != last; ++first) {
+        roots_.emplace_back(NewNode(*first));
+    }
+    size_ = roots_.size();
+    // the heaps are merged in pairs, round by round: a round halves the number of heaps and the merges of a round
+    // take time proportional to the number of heaps before it, so all of them take O(n)
+    while (roots_.size() > 1) {
+        size_t merged = 0;
+        for (size_t i = 0; i + 1 < roots_.size(); i += 2) {
+            roots_[merged++] = Merge(roots_[i], roots_[i + 1]);
+        }
+        if (roots_.size() % 2 == 1) {
+            roots_[merged++] = roots_.back();
+        }
+        roots_.resize(merged);
+    }
+    root_ = roots_.empty() ? NIL : roots_[0];
+    roots_.clear();
 }
 
-template <class T, class Compare>
-T LeftistHeap<T, Compare>::Top() {
+template <class T, class Compare, class Allocator>
+template <class... Args>
+void LeftistHeap<T, Compare, Allocator>::Emplace(Args&&... args) {
+    root_ = Merge(NewNode(std::forward<Args>(args)...), root_);
+    ++size_;
+}
+
+template <class T, class Compare, class Allocator>
+void LeftistHeap<T, Compare, Allocator>::Insert(const T& value) {
+    Emplace(value);
+}
+
+template <class T, class Compare, class Allocator>
+void LeftistHeap<T, Compare, Allocator>::Insert(T&& value) {
+    Emplace(std::move(value));
+}
+
+template <class T, class Compare, class Allocator>
+const T& LeftistHeap<T, Compare, Allocator>::Top() const {
     if (Empty()) {
         throw std::runtime_error("Error: No top element in an empty heap");
     }
-    if (root_ == nullptr) {
-        throw std::runtime_error("Error: Heap root is invalid");
-    }
-    return root_->val;
+    return nodes_[root_].val;
 }
 
-template <class T, class Compare>
-T LeftistHeap<T, Compare>::Extract() {
+template <class T, class Compare, class Allocator>
+T LeftistHeap<T, Compare, Allocator>::Extract() {
     if (Empty()) {
         throw std::runtime_error("Error: Extracting from an empty heap");
     }
-    if (root_ == nullptr) {
-        throw std::runtime_error("Error: Heap root is invalid");
-    }
-    T top = root_->val;
-    auto left = root_->left;
-    auto right = root_->right;
-    delete root_;
-    root_ = Merge(left, right);
+    NodeIndex top = root_;
+    root_ = Merge(nodes_[top].left, nodes_[top].right);
+    nodes_[top].right = free_;
+    free_ = top;
     --size_;
-    return top;
+    return std::move(nodes_[top].val);
 }
 
-template <class T, class Compare>
-bool LeftistHeap<T, Compare>::Empty() const {
+template <class T, class Compare, class Allocator>
+bool LeftistHeap<T, Compare, Allocator>::Empty() const {
     return size_ == 0;
 }
 
-template <class T, class Compare>
-size_t LeftistHeap<T, Compare>::Size() const {
+template <class T, class Compare, class Allocator>
+size_t LeftistHeap<T, Compare, Allocator>::Size() const {
     return size_;
 }
 
-template <class T, class Compare>
-void LeftistHeap<T, Compare>::Delete(LeftistHeap::Node* node) {
-    if (node == nullptr) {
-        return;
-    }
-    Delete(node->left);
-    Delete(node->right);
-    delete node;
-}
-
-template <class T, class Compare>
-LeftistHeap<T, Compare>::~LeftistHeap() {
-    Delete(root_);
+template <class T, class Compare, class Allocator>
+void LeftistHeap<T, Compare, Allocator>::Clear() {
+    nodes_.clear();
+    root_ = NIL;
+    free_ = NIL;
+    size_ = 0;
 }
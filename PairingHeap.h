@@ -0,0 +1,167 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+// A pairing heap: Insert() links a node in O(1), Extract() pairs up the children of the root in two passes. The
+// nodes are kept in one vector and linked by 32-bit indices like in LeftistHeap.
+template <class T, class Compare = std::less<T>>
+class PairingHeap {
+public:
+    template <class Iterator>
+    void Assign(Iterator first, Iterator last);  // replaces the values
+    template <class... Args>
+    void Emplace(Args&&... args);
+    void Insert(const T& value);
+    void Insert(T&& value);
+    T Extract();  // moves the value out
+    [[nodiscard]] const T& Top() const;
+    [[nodiscard]] bool Empty() const;
+    [[nodiscard]] size_t Size() const;
+    void Clear();  // keeps the memory of the nodes
+
+private:
+    using NodeIndex = uint32_t;
+    constexpr static const NodeIndex NIL = UINT32_MAX;
+
+    struct Node {
+        template <class... Args>
+        explicit Node(Args&&... args);
+        T val;
+        NodeIndex child = NIL;    // the first one
+        NodeIndex sibling = NIL;  // the next free node for the free nodes
+    };
+
+    template <class... Args>
+    NodeIndex NewNode(Args&&... args);
+    NodeIndex Link(NodeIndex x, NodeIndex y);  // of two roots
+
+    std::vector<Node> nodes_;
+    std::vector<NodeIndex> pairs_;  // the linked pairs of the children during Extract()
+    NodeIndex root_ = NIL;
+    NodeIndex free_ = NIL;
+    size_t size_ = 0;
+};
+
+template <class T, class Compare>
+template <class... Args>
+PairingHeap<T, Compare>::Node::Node(Args&&... args) : val(std::forward<Args>(args)...) {
+}
+
+template <class T, class Compare>
+template <class... Args>
+typename PairingHeap<T, Compare>::NodeIndex PairingHeap<T, Compare>::NewNode(Args&&... args) {
+    if (free_ == NIL) {
+        if (nodes_.size() == NIL) {
+            throw std::runtime_error("Error: Too many values in a heap");
+        }
+        nodes_.emplace_back(std::forward<Args>(args)...);
+        return nodes_.size() - 1;
+    }
+    NodeIndex v = free_;
+    free_ = nodes_[v].sibling;
+    nodes_[v].val = T(std::forward<Args>(args)...);
+    nodes_[v].child = NIL;
+    nodes_[v].sibling = NIL;
+    return v;
+}
+
+template <class T, class Compare>
+typename PairingHeap<T, Compare>::NodeIndex PairingHeap<T, Compare>::Link(NodeIndex x, NodeIndex y) {
+    if (x == NIL) {
+        return y;
+    }
+    if (y == NIL) {
+        return x;
+    }
+    if (Compare()(nodes_[y].val, nodes_[x].val)) {
+        std::swap(x, y);
+    }
+    nodes_[y].sibling = nodes_[x].child;
+    nodes_[x].child = y;
+    return x;
+}
+
+template <class T, class Compare>
+template <class Iterator>
+void PairingHeap<T, Compare>::Assign(Iterator first, Iterator last) {
+    Clear();
+    for (; first != last; ++first) {
+        root_ = Link(root_, NewNode(*first));
+        ++size_;
+    }
+}
+
+template <class T, class Compare>
+template <class... Args>
+void PairingHeap<T, Compare>::Emplace(Args&&... args) {
+    root_ = Link(root_, NewNode(std::forward<Args>(args)...));
+    ++size_;
+}
+
+template <class T, class Compare>
+void PairingHeap<T, Compare>::Insert(const T& value) {
+    Emplace(value);
+}
+
+template <class T, class Compare>
+void PairingHeap<T, Compare>::Insert(T&& value) {
+    Emplace(std::move(value));
+}
+
+template <class T, class Compare>
+T PairingHeap<T, Compare>::Extract() {
+    if (Empty()) {
+        throw std::runtime_error("Error: Extracting from an empty heap");
+    }
+    NodeIndex top = root_;
+    // the children are linked in pairs from left to right, then the pairs are linked from right to left
+    pairs_.clear();
+    for (NodeIndex child = nodes_[top].child; child != NIL;) {
+        NodeIndex second = nodes_[child].sibling;
+        NodeIndex next = second == NIL ? NIL : nodes_[second].sibling;
+        nodes_[child].sibling = NIL;
+        if (second != NIL) {
+            nodes_[second].sibling = NIL;
+        }
+        pairs_.emplace_back(Link(child, second));
+        child = next;
+    }
+    root_ = NIL;
+    for (auto pair = pairs_.rbegin(); pair != pairs_.rend(); ++pair) {
+        root_ = Link(*pair, root_);
+    }
+    nodes_[top].sibling = free_;
+    free_ = top;
+    --size_;
+    return std::move(nodes_[top].val);
+}
+
+template <class T, class Compare>
+const T& PairingHeap<T, Compare>::Top() const {
+    if (Empty()) {
+        throw std::runtime_error("Error: No top element in an empty heap");
+    }
+    return nodes_[root_].val;
+}
+
+template <class T, class Compare>
+bool PairingHeap<T, Compare>::Empty() const {
+    return size_ == 0;
+}
+
+template <class T, class Compare>
+size_t PairingHeap<T, Compare>::Size() const {
+    return size_;
+}
+
+template <class T, class Compare>
+void PairingHeap<T, Compare>::Clear() {
+    nodes_.clear();
+    root_ = NIL;
+    free_ = NIL;
+    size_ = 0;
+}
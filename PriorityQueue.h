@@ -0,0 +1,44 @@
+#pragma once
+
+#include <concepts>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "DaryHeap.h"
+#include "LeftistHeap.h"
+#include "PairingHeap.h"
+
+// The operations the Huffman code builders need from a min-priority queue of T
+template <class Queue, class T>
+concept PriorityQueue = requires(Queue queue, const Queue& const_queue, T value, std::vector<T> values) {
+    queue.Assign(values.begin(), values.end());
+    queue.Insert(std::move(value));
+    queue.Emplace(std::move(value));
+    { queue.Extract() } -> std::same_as<T>;
+    { const_queue.Top() } -> std::same_as<const T&>;
+    { const_queue.Size() } -> std::convertible_to<size_t>;
+    { const_queue.Empty() } -> std::convertible_to<bool>;
+    queue.Clear();
+};
+
+// A queue policy picks the priority queue for the values of type T ordered by Compare
+struct LeftistHeapPolicy {
+    template <class T, class Compare>
+    using Queue = LeftistHeap<T, Compare>;
+};
+
+struct BinaryHeapPolicy {
+    template <class T, class Compare>
+    using Queue = DaryHeap<T, Compare, 2>;
+};
+
+struct QuaternaryHeapPolicy {
+    template <class T, class Compare>
+    using Queue = DaryHeap<T, Compare, 4>;
+};
+
+struct PairingHeapPolicy {
+    template <class T, class Compare>
+    using Queue = PairingHeap<T, Compare>;
+};
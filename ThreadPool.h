@@ -0,0 +1,28 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs the submitted tasks on a fixed set of threads in the order of submission
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threads);  // std::thread::hardware_concurrency() threads for zero
+    // the future rethrows the exception of the task
+    std::future<void> Submit(std::function<void()> task);
+    [[nodiscard]] size_t Size() const;
+    ~ThreadPool();
+
+private:
+    void Work();
+
+    std::mutex mutex_;
+    std::condition_variable tasks_cv_;
+    std::deque<std::packaged_task<void()>> tasks_;
+    bool stopped_ = false;
+    std::vector<std::thread> workers_;
+};
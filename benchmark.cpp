@@ -0,0 +1,60 @@
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "CodeLengths.h"
+
+// Compares the priority queues of the Huffman code builder: many codes for small alphabets like the one of the
+// archiver, a few codes for large alphabets
+namespace {
+volatile uint64_t checksum_sink = 0;  // the results are used, so the builds are not optimized away
+
+template <class Builder>
+double MeasureNanosPerCode(Builder& builder, const std::vector<std::vector<uint64_t>>& blocks, size_t repeats) {
+    uint64_t checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t repeat = 0; repeat < repeats; ++repeat) {
+        for (const auto& freqs : blocks) {
+            checksum += builder.BuildCodeLengths(freqs)[0];
+        }
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    checksum_sink = checksum;
+    return elapsed.count() / static_cast<double>(repeats * blocks.size());
+}
+
+template <class QueuePolicy>
+void Benchmark(const std::string& name, const std::vector<std::vector<uint64_t>>& small,
+               const std::vector<std::vector<uint64_t>>& large) {
+    Huffman::HeapCodeLengthsBuilder<QueuePolicy> builder;
+    std::cout << std::setw(12) << name << std::fixed << std::setprecision(1) << std::setw(14)
+              << MeasureNanosPerCode(builder, small, 20) / 1000 << std::setw(14)
+              << MeasureNanosPerCode(builder, large, 5) / 1000 << std::endl;
+}
+
+std::vector<std::vector<uint64_t>> RandomFrequencies(size_t blocks, size_t symbols, std::mt19937_64& rnd) {
+    std::vector<std::vector<uint64_t>> result(blocks, std::vector<uint64_t>(symbols));
+    for (auto& freqs : result) {
+        for (auto& freq : freqs) {  // skewed like the byte frequencies of text
+            freq = rnd() % (uint64_t(1) << (rnd() % 20));
+        }
+    }
+    return result;
+}
+}  // namespace
+
+int main() {
+    std::mt19937_64 rnd(2022);
+    auto small = RandomFrequencies(1000, 259, rnd);
+    auto large = RandomFrequencies(10, 65536, rnd);
+    std::cout << std::setw(12) << "queue" << std::setw(14) << "259, us" << std::setw(14) << "65536, us" << std::endl;
+    Benchmark<LeftistHeapPolicy>("leftist", small, large);
+    Benchmark<BinaryHeapPolicy>("binary", small, large);
+    Benchmark<QuaternaryHeapPolicy>("4-ary", small, large);
+    Benchmark<PairingHeapPolicy>("pairing", small, large);
+    return 0;
+}
@@ -3,6 +3,8 @@
 #include "ArgsProcessing.h"
 #include "HuffmanCodec.h"
 
+const size_t ASYNC_IO_QUEUE_DEPTH = 16;
+
 int main(int argc, char* argv[]) {
     ArgumentsProcessing arg_proc(argc, argv);
     ArgumentsProcessing::ParsingResult parsing_result = arg_proc.parsing_result;
@@ -15,16 +17,35 @@ int main(int argc, char* argv[]) {
         return 0;
     }
 
+    Huffman::Options options;
+    if (arg_proc.async_io) {
+        options.io_backend = CreateAsyncIoBackend(ASYNC_IO_QUEUE_DEPTH);
+    }
+    if (arg_proc.legacy_format) {
+        options.format_version = Huffman::LEGACY_FORMAT;
+    }
+    if (arg_proc.max_code_length) {
+        options.max_code_length = *arg_proc.max_code_length;
+    }
+    if (arg_proc.block_size) {
+        options.block_size = *arg_proc.block_size * 1024;
+    }
+    if (arg_proc.threads) {
+        options.threads = *arg_proc.threads;
+    }
+
     if (parsing_result == ArgumentsProcessing::ParsingResult::Encode) {
         std::cout << "Encoding..." << std::endl;
         try {
-            std::ofstream out(arg_proc.archive_name, std::ios::binary);  // checked that the file exists
-            Huffman::Coder coder(out);
+            auto archive = options.io_backend ? CreateAsyncFileSink(arg_proc.archive_name, options.io_backend)
+                                              : CreateMappedFileSink(arg_proc.archive_name, 0);
+            Huffman::Coder coder(std::move(archive), options);
 
+            coder.AddFiles(arg_proc.files);
             for (const auto& file : arg_proc.files) {
-                coder.AddFile(file);
                 std::cout << "Encoded file " << file << std::endl;
             }
+            coder.Close();
         } catch (std::runtime_error& e) {
             std::cerr << e.what() << std::endl;
             return 1;
@@ -35,8 +56,7 @@ int main(int argc, char* argv[]) {
     } else {
         std::cout << "Decoding..." << std::endl;
         try {
-            std::ifstream in(arg_proc.archive_name, std::ios::binary);
-            Huffman::Decoder decoder(in);
+            Huffman::Decoder decoder(arg_proc.archive_name, options);
             decoder.Decode();
 
         } catch (std::runtime_error& e) {
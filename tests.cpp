@@ -1,11 +1,27 @@
+#include <cmath>
+#include <filesystem>
 #include <iostream>
 #include <map>
+#include <random>
+#include <set>
+#include <sys/resource.h>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
 
 #include "ArgsProcessing.h"
+#include "AsyncIO.h"
 #include "BitIO.h"
+#include "ByteHistogram.h"
+#include "ByteSink.h"
+#include "ByteSource.h"
 #include "catch.hpp"
+#include "CodeLengths.h"
+#include "DecodeTable.h"
+#include "HuffmanCodec.h"
 #include "HuffmanTree.h"
 #include "LeftistHeap.h"
+#include "PriorityQueue.h"
 
 TEST_CASE("Heap_test") {
     {
@@ -114,6 +130,40 @@ TEST_CASE("Command line arguments processing (errors)") {
         REQUIRE(arg_proc.parsing_result == ArgumentsProcessing::ParsingResult::Error);
         REQUIRE(arg_proc.error_message == "Error: Incorrect first argument");
     }
+    {  // unknown option
+        std::vector<std::string> v_args = {"current_directory/archiver.exe", "-d", "--sync-io", "archive"};
+        int argc = 4;
+        char* argv[argc];
+        for (int i = 0; i < argc; ++i) {
+            argv[i] = v_args[i].data();
+        }
+        ArgumentsProcessing arg_proc(argc, argv);
+        REQUIRE(arg_proc.parsing_result == ArgumentsProcessing::ParsingResult::Error);
+        REQUIRE(arg_proc.error_message == "Error: Unknown option --sync-io");
+    }
+    {  // incorrect option value
+        std::vector<std::string> v_args = {"current_directory/archiver.exe", "-d", "--max-code-length=x", "archive"};
+        int argc = 4;
+        char* argv[argc];
+        for (int i = 0; i < argc; ++i) {
+            argv[i] = v_args[i].data();
+        }
+        ArgumentsProcessing arg_proc(argc, argv);
+        REQUIRE(arg_proc.parsing_result == ArgumentsProcessing::ParsingResult::Error);
+        REQUIRE(arg_proc.error_message == "Error: Incorrect value of option --max-code-length=x");
+    }
+    for (std::string block_size : {"63", "262145", "999999999"}) {  // out of the range in KiB
+        std::vector<std::string> v_args = {"current_directory/archiver.exe", "-d", "--block-size=" + block_size,
+                                           "archive"};
+        int argc = 4;
+        char* argv[argc];
+        for (int i = 0; i < argc; ++i) {
+            argv[i] = v_args[i].data();
+        }
+        ArgumentsProcessing arg_proc(argc, argv);
+        REQUIRE(arg_proc.parsing_result == ArgumentsProcessing::ParsingResult::Error);
+        REQUIRE(arg_proc.error_message == "Error: Incorrect value of option --block-size=" + block_size);
+    }
     std::cout << "Command line arguments processing tests passed" << std::endl;
 }
 
@@ -214,6 +264,225 @@ TEST_CASE("BitWriter") {
     std::cout << "BitWriter tests passed" << std::endl;
 }
 
+TEST_CASE("BitWriter word accumulator") {
+    std::string test_file = "binary_IO_test";
+    std::mt19937_64 rnd(1337);
+    std::vector<bool> bits;
+
+    {  // writing a mix of codes longer than the output buffer
+        std::ofstream out(test_file, std::ios::binary);
+        BitWriter bin_out(out);
+        for (size_t i = 0; i < 300'000; ++i) {
+            size_t len = rnd() % 65;
+            uint64_t value = rnd();
+            if (i % 3 == 0) {
+                bin_out.WriteBits(value, len);
+                for (size_t bit = len; bit > 0; --bit) {
+                    bits.emplace_back((value >> (bit - 1)) & 1);
+                }
+            } else if (i % 3 == 1) {
+                len = std::min<size_t>(len, 63);
+                bin_out.Write(value, len);
+                for (size_t bit = 0; bit < len; ++bit) {
+                    bits.emplace_back((value >> bit) & 1);
+                }
+            } else {
+                std::vector<bool> code;
+                for (size_t bit = 0; bit < len; ++bit) {
+                    code.emplace_back((value >> bit) & 1);
+                }
+                bin_out.Write(code);
+                bits.insert(bits.end(), code.begin(), code.end());
+            }
+        }
+    }
+    {  // checking
+        std::ifstream in(test_file, std::ios::binary);
+        std::vector<char> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        std::vector<char> correct_bytes((bits.size() + 7) / 8);
+        for (size_t i = 0; i < bits.size(); ++i) {
+            correct_bytes[i / 8] |= static_cast<char>(bits[i] << (7 - i % 8));
+        }
+        REQUIRE(bytes == correct_bytes);
+    }
+    std::cout << "BitWriter word accumulator tests passed" << std::endl;
+}
+
+TEST_CASE("BitReader window") {
+    std::string test_file = "binary_IO_test";
+    std::mt19937_64 rnd(42);
+    std::vector<std::pair<uint64_t, size_t>> values;
+    {
+        std::ofstream out(test_file, std::ios::binary);
+        BitWriter bin_out(out);
+        for (size_t i = 0; i < 400'000; ++i) {
+            size_t len = rnd() % 65;
+            uint64_t value = len == 64 ? rnd() : rnd() & ((uint64_t(1) << len) - 1);
+            bin_out.WriteBits(value, len);
+            values.emplace_back(value, len);
+        }
+        bin_out.Write(0b101, 3);
+    }
+
+    std::ifstream in(test_file, std::ios::binary);
+    BitReader bin_in(in);
+    for (size_t i = 0; i < values.size(); ++i) {
+        auto [value, len] = values[i];
+        if (i % 2 == 0 && len <= 56) {
+            REQUIRE(bin_in.Peek(len) == value);
+            bin_in.Consume(len);
+        } else {
+            REQUIRE(bin_in.ReadBits(len) == value);
+        }
+    }
+    REQUIRE(bin_in.Read(3) == 0b101);
+    size_t tail_bits = 0;
+    for (const auto& [value, len] : values) {
+        tail_bits += len;
+    }
+    tail_bits = (8 - (tail_bits + 3) % 8) % 8;
+    REQUIRE(bin_in.Peek(56) == 0);  // zero-padded after the end of file
+    REQUIRE_NOTHROW(bin_in.Consume(tail_bits));
+    REQUIRE_THROWS_AS(bin_in.Consume(1), std::runtime_error);
+    std::cout << "BitReader window tests passed" << std::endl;
+}
+
+TEST_CASE("Byte sources") {
+    std::string test_file = "byte_source_test";
+    std::string data;
+    for (size_t i = 0; i < 3'000'000; ++i) {
+        data += static_cast<char>(i * 7 % 251);
+    }
+    {
+        std::ofstream out(test_file, std::ios::binary);
+        out << data;
+    }
+    auto read_all = [](ByteSource& source) {
+        std::string res;
+        for (auto chunk = source.Next(); !chunk.empty(); chunk = source.Next()) {
+            res.append(chunk.data(), chunk.size());
+        }
+        return res;
+    };
+
+    auto mapped = OpenFileSource(test_file, true);
+    REQUIRE(dynamic_cast<MappedFileSource*>(mapped.get()) != nullptr);
+    REQUIRE(read_all(*mapped) == data);
+
+    int pipe_fds[2];
+    REQUIRE(pipe(pipe_fds) == 0);
+    std::thread writer([&] {
+        for (size_t pos = 0; pos < data.size();) {
+            pos += write(pipe_fds[1], data.data() + pos, std::min<size_t>(data.size() - pos, 12345));
+        }
+        close(pipe_fds[1]);
+    });
+    FileSource piped(pipe_fds[0]);
+    REQUIRE(read_all(piped) == data);
+    writer.join();
+
+    {  // both sources are read by BitReader in the same way
+        BitReader mapped_in(OpenFileSource(test_file));
+        std::ifstream in(test_file, std::ios::binary);
+        BitReader stream_in(in);
+        for (size_t i = 0; i < data.size() / 8; ++i) {
+            REQUIRE(mapped_in.ReadBits(64) == stream_in.ReadBits(64));
+        }
+    }
+    std::cout << "Byte sources tests passed" << std::endl;
+}
+
+TEST_CASE("Byte sinks") {
+    std::string test_file = "byte_sink_test";
+    auto write_bits = [](BitWriter& bin_out) {
+        std::mt19937_64 rnd(7);
+        for (size_t i = 0; i < 500'000; ++i) {
+            bin_out.WriteBits(rnd(), rnd() % 65);
+        }
+        bin_out.Write(1, 3);  // the last byte is not full
+        bin_out.Close();
+    };
+    auto read_file = [](const std::string& file_name) {
+        std::ifstream in(file_name, std::ios::binary);
+        return std::vector<char>((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    };
+
+    VectorSink vector_sink;
+    {
+        BitWriter bin_out(vector_sink);
+        write_bits(bin_out);
+    }
+    const auto& data = vector_sink.Data();
+    {
+        std::ofstream out(test_file, std::ios::binary);
+        BitWriter bin_out(out);
+        write_bits(bin_out);
+        REQUIRE(read_file(test_file) == data);
+    }
+    {
+        BitWriter bin_out(CreateFileSink(test_file));
+        write_bits(bin_out);
+        REQUIRE(read_file(test_file) == data);
+    }
+    {
+        BitWriter bin_out(CreateMappedFileSink(test_file, 1000));  // grows several times
+        write_bits(bin_out);
+        REQUIRE(read_file(test_file) == data);
+    }
+    {
+        std::vector<char> memory(data.size());
+        MemorySink memory_sink(memory);
+        BitWriter bin_out(memory_sink);
+        write_bits(bin_out);
+        REQUIRE(memory_sink.Size() == data.size());
+        REQUIRE(memory == data);
+
+        MemorySink small_sink(std::span<char>(memory).first(data.size() - 1));
+        BitWriter small_out(small_sink);
+        REQUIRE_THROWS_AS(write_bits(small_out), std::runtime_error);
+    }
+    std::cout << "Byte sinks tests passed" << std::endl;
+}
+
+TEST_CASE("Asynchronous I/O") {
+    std::string test_file = "async_io_test";
+    std::vector<char> data(10'000'000);
+    std::mt19937 rnd(5);
+    for (auto& c : data) {
+        c = static_cast<char>(rnd());
+    }
+
+    std::vector<std::shared_ptr<AsyncIoBackend>> backends = {std::make_shared<ThreadPoolBackend>(8, 3)};
+    try {
+        backends.emplace_back(std::make_shared<UringBackend>(8));
+    } catch (std::runtime_error& e) {
+        std::cout << "io_uring is not tested: " << e.what() << std::endl;
+    }
+    for (const auto& backend : backends) {
+        {
+            auto sink = CreateAsyncFileSink(test_file, backend);
+            for (size_t pos = 0; pos < data.size();) {  // uneven writes
+                auto buffer = sink->GetBuffer(1);
+                size_t size = std::min({buffer.size(), data.size() - pos, size_t(rnd() % 100'000 + 1)});
+                std::copy_n(data.data() + pos, size, buffer.data());
+                sink->Commit(size);
+                pos += size;
+            }
+            sink->Close();
+        }
+        auto source = OpenAsyncFileSource(test_file, backend);
+        for (size_t pass = 0; pass < 2; ++pass) {
+            std::vector<char> read_data;
+            for (auto chunk = source->Next(); !chunk.empty(); chunk = source->Next()) {
+                read_data.insert(read_data.end(), chunk.begin(), chunk.end());
+            }
+            REQUIRE(read_data == data);
+            REQUIRE(source->Rewind());
+        }
+    }
+    std::cout << "Asynchronous I/O tests passed" << std::endl;
+}
+
 TEST_CASE("Huffman tree") {
     std::string file_name = "huffman_tree_test";
     std::map<char, std::string> string_codes = {
@@ -270,4 +539,959 @@ TEST_CASE("Huffman tree") {
     bin_in.Close();
     REQUIRE(decoded_data == data);
     std::cout << "Huffman tree tests passed" << std::endl;
-}
\ No newline at end of file
+}
+
+struct TestFile {
+    std::string name;
+    std::span<const char> data;
+    ByteSource* source = nullptr;  // of the data, it is read from memory if not set
+};
+
+struct TestArchive {
+    std::vector<char> data;
+    uint64_t max_bits = 0;  // by Coder::MemberBits() and Coder::IndexBits(), for the versioned formats
+};
+
+TestArchive EncodeTestFiles(const std::vector<TestFile>& files, const Huffman::Options& options) {
+    VectorSink archive;
+    uint64_t bits = 64;  // the archive header
+    {
+        Huffman::Coder coder(archive, options);
+        for (size_t i = 0; i < files.size(); ++i) {
+            MemorySource memory(files[i].data);
+            coder.AddFile(files[i].name, files[i].source != nullptr ? *files[i].source : memory);
+            bits += coder.MemberBits(i + 1 == files.size());
+            bits = (bits + 7) / 8 * 8;  // the next member and the index start at a byte boundary
+        }
+        bits += coder.IndexBits();
+        coder.Close();
+    }
+    return {archive.Release(), bits};
+}
+
+// decodes the archive in place of the files, checks their contents and the names printed by the decoder
+void CheckDecodedTestFiles(std::span<const char> archive, const std::vector<TestFile>& files,
+                           const Huffman::Options& options = {}) {
+    for (const auto& file : files) {
+        std::filesystem::remove(file.name);
+    }
+    std::ostringstream printed;
+    {
+        struct CoutRedirect {
+            std::streambuf* buffer;
+            ~CoutRedirect() {
+                std::cout.rdbuf(buffer);
+            }
+        } redirect{std::cout.rdbuf(printed.rdbuf())};
+        Huffman::Decoder decoder(std::make_unique<MemorySource>(archive), options);
+        decoder.Decode();
+    }
+    std::string expected_printed;
+    for (const auto& file : files) {
+        expected_printed += "Decoded file " + file.name + "\n";
+        std::ifstream in(file.name, std::ios::binary);
+        REQUIRE(std::vector<char>((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>()) ==
+                std::vector<char>(file.data.begin(), file.data.end()));
+    }
+    REQUIRE(printed.str() == expected_printed);
+}
+
+TEST_CASE("Coder and Decoder roundtrip") {
+    std::vector<std::string> file_names = {"roundtrip_test_1", "roundtrip_test_2", "roundtrip_test_3"};
+    std::vector<std::vector<char>> files(file_names.size());
+    std::mt19937 rnd(2022);
+    for (size_t i = 0; i < 100'000; ++i) {
+        files[0].emplace_back(static_cast<char>(rnd()));  // all bytes including 0xFF
+        files[1].emplace_back(static_cast<char>('a' + rnd() % 3));
+    }
+    files[2].emplace_back('\xFF');
+
+    std::vector<TestFile> test_files;
+    for (size_t i = 0; i < files.size(); ++i) {
+        test_files.push_back({file_names[i], files[i]});
+    }
+    CheckDecodedTestFiles(EncodeTestFiles(test_files, {}).data, test_files);
+    std::cout << "Coder and Decoder roundtrip tests passed" << std::endl;
+}
+
+TEST_CASE("Exact member size") {
+    std::vector<char> text;
+    std::mt19937 rnd(3);
+    for (size_t i = 0; i < 50'000; ++i) {
+        text.emplace_back(static_cast<char>('a' + rnd() % 20 * rnd() % 20));
+    }
+    VectorSink archive;
+    uint64_t bits = 64;  // the archive header
+    {
+        Huffman::Options options;
+        options.block_size = 0;
+        Huffman::Coder coder(archive, options);
+        MemorySource first(text);
+        coder.AddFile("first", first);
+        bits += coder.MemberBits(false);
+        bits = (bits + 7) / 8 * 8;  // the next member starts at a byte boundary
+
+        MemorySource second(std::span<const char>(text).first(777));
+        coder.AddFile("second", second);
+        bits += coder.MemberBits(true);
+        bits = (bits + 7) / 8 * 8 + coder.IndexBits();  // the index starts at a byte boundary
+        coder.Close();
+    }
+    REQUIRE(archive.Data().size() == (bits + 7) / 8);
+    std::cout << "Exact member size tests passed" << std::endl;
+}
+
+TEST_CASE("Archive format versions") {
+    {
+        VectorSink sink;
+        {
+            BitWriter writer(sink, BitOrder::LsbFirst);
+            writer.Write(0b101, 3);
+            writer.WriteBits(0b1100, 4);
+            writer.Write(0xABCDEF0123456789, 64);
+            writer.Write(1, 1);
+            writer.Close();
+        }
+        REQUIRE((sink.Data()[0] & 0x7F) == 0b0011101);  // the first bit is the lowest one
+
+        MemorySource source(sink.Data());
+        BitReader reader(source, BitOrder::LsbFirst);
+        REQUIRE(reader.Read(3) == 0b101);
+        REQUIRE(reader.ReadBits(4) == 0b1100);
+        REQUIRE(reader.Read(64) == 0xABCDEF0123456789);
+        REQUIRE(reader.Get());
+    }
+    {
+        std::vector<char> bytes = {'\x12', '\x34', '\x56'};
+        MemorySource source(bytes);
+        BitReader reader(source);
+        REQUIRE(reader.ReadBits(8) == 0x12);
+        reader.SetBitOrder(BitOrder::LsbFirst);
+        REQUIRE(reader.Read(8) == 0x34);
+        reader.SetBitOrder(BitOrder::MsbFirst);
+        REQUIRE(reader.ReadBits(4) == 0x5);
+        REQUIRE_THROWS(reader.SetBitOrder(BitOrder::LsbFirst));
+    }
+
+    std::vector<char> text;
+    std::mt19937 rnd(8);
+    for (size_t i = 0; i < 30'000; ++i) {
+        text.emplace_back(static_cast<char>(rnd() % 256));
+    }
+    for (auto version : {Huffman::LEGACY_FORMAT, Huffman::FORMAT_VERSION}) {
+        std::vector<TestFile> files = {{"format_test", text}};
+        Huffman::Options options;
+        options.format_version = version;
+        auto archive = EncodeTestFiles(files, options);
+        REQUIRE((archive.data[0] == 0) == (version != Huffman::LEGACY_FORMAT));
+        CheckDecodedTestFiles(archive.data, files);
+    }
+    std::filesystem::remove("format_test");
+
+    Huffman::Options options;
+    options.format_version = Huffman::FORMAT_VERSION + 1;
+    VectorSink archive;
+    REQUIRE_THROWS(Huffman::Coder(archive, options));
+    std::cout << "Archive format versions tests passed" << std::endl;
+}
+
+TEST_CASE("Unchecked reading") {
+    class SmallChunksSource : public ByteSource {  // splits the data into chunks of 1 to 11 bytes
+    public:
+        explicit SmallChunksSource(const std::vector<char>& data) : data_(data) {
+        }
+        std::span<const char> Next() override {
+            size_t size = std::min(data_.size() - pos_, pos_ % 11 + 1);
+            chunk_.assign(data_.begin() + pos_, data_.begin() + pos_ + size);  // the previous chunk is invalidated
+            pos_ += size;
+            return chunk_;
+        }
+        void Close() override {
+        }
+
+    private:
+        const std::vector<char>& data_;
+        std::vector<char> chunk_;
+        size_t pos_ = 0;
+    };
+
+    std::vector<char> data;
+    std::mt19937 rnd(9);
+    for (size_t i = 0; i < 1000; ++i) {
+        data.emplace_back(static_cast<char>(rnd()));
+    }
+    SmallChunksSource small_chunks(data);
+    MemorySource memory(data);
+    BitReader chunked_in(small_chunks, BitOrder::LsbFirst);
+    BitReader memory_in(memory, BitOrder::LsbFirst);
+    size_t bits_left = data.size() * 8;
+    while (bits_left > 0) {
+        size_t len = std::min<size_t>(rnd() % 57, bits_left);
+        REQUIRE(chunked_in.Peek(len) == memory_in.Peek(len));
+        chunked_in.Skip(len);
+        memory_in.Skip(len);
+        bits_left -= len;
+    }
+    REQUIRE(chunked_in.Status() == ReadStatus::Ok);
+    REQUIRE(chunked_in.Peek(56) == 0);
+    chunked_in.Skip(1);
+    REQUIRE(chunked_in.Status() == ReadStatus::Overrun);
+
+    VectorSink archive;
+    {
+        Huffman::Coder coder(archive);
+        MemorySource source(data);
+        coder.AddFile("unchecked_test", source);
+        coder.Close();
+    }
+    auto truncated = archive.Data();
+    truncated.resize(truncated.size() / 2);
+    Huffman::Options sequential;
+    sequential.threads = 1;  // the overruns are detected by the readers, not by the index
+    Huffman::Decoder decoder(std::make_unique<MemorySource>(truncated), sequential);
+    REQUIRE_THROWS_WITH(decoder.Decode(), "Error: unexpected end of file");
+
+    Huffman::Options indexed;
+    indexed.threads = 2;
+    Huffman::Decoder truncated_decoder(std::make_unique<MemorySource>(truncated), indexed);
+    REQUIRE_THROWS_WITH(truncated_decoder.Decode(), "Error: The file is invalid, the index is out of the archive");
+    auto overrun = archive.Release();  // the encoded size of the only block is past the end of the archive
+    MemorySource offset_source(std::span<const char>(overrun).last(8));
+    uint64_t index_offset = BitReader(offset_source, BitOrder::LsbFirst).Read(64);
+    // the number of members, the offset, the size and the number of blocks of the member precede the block offset
+    MemorySource block_source(std::span<const char>(overrun).subspan(index_offset + 32, 8));
+    uint64_t block_offset = BitReader(block_source, BitOrder::LsbFirst).Read(64);
+    for (size_t byte = 0; byte < 4; ++byte) {
+        overrun[block_offset + 4 + byte] = '\xFF';
+    }
+    Huffman::Decoder overrun_decoder(std::make_unique<MemorySource>(std::move(overrun)), indexed);
+    REQUIRE_THROWS_WITH(overrun_decoder.Decode(), "Error: unexpected end of file");
+    std::filesystem::remove("unchecked_test");
+    std::cout << "Unchecked reading tests passed" << std::endl;
+}
+
+TEST_CASE("Decode table") {
+    // codes 0, 10, 110, 111 for the symbols a, b, c, d
+    std::vector<Huffman::Symbol> symbols = {'a', 'b', 'c', 'd'};
+    std::vector<size_t> length_counts = {0, 1, 1, 2};
+    for (auto order : {BitOrder::MsbFirst, BitOrder::LsbFirst}) {
+        Huffman::DecodeTable table;
+        table.Build(symbols, length_counts, order);
+        REQUIRE(table.TableBits() == 3);
+
+        VectorSink sink;
+        {
+            BitWriter writer(sink, order);
+            writer.WriteBits(0b110'0'111'10, 9);
+            writer.Close();
+        }
+        MemorySource source(sink.Data());
+        BitReader reader(source, order);
+        std::string decoded;
+        for (size_t i = 0; i < 4; ++i) {
+            const auto& entry = table.Lookup(reader);
+            reader.Skip(entry.len);
+            decoded += static_cast<char>(entry.symbol);
+        }
+        REQUIRE(decoded == "cadb");
+    }
+    Huffman::DecodeTable table;
+    REQUIRE_THROWS_AS(table.Build(symbols, {0, 2, 1, 1}, BitOrder::MsbFirst), std::runtime_error);
+
+    // Fibonacci frequencies give codes longer than the table
+    std::vector<char> text;
+    size_t prev = 1;
+    size_t freq = 1;
+    for (char c = 'a'; c < 'a' + 25; ++c) {
+        text.insert(text.end(), freq, c);
+        std::tie(prev, freq) = std::make_pair(freq, prev + freq);
+    }
+    std::shuffle(text.begin(), text.end(), std::mt19937(10));
+    for (auto version : {Huffman::LEGACY_FORMAT, Huffman::FORMAT_VERSION}) {
+        std::vector<TestFile> files = {{"decode_table_test", text}};
+        Huffman::Options options;
+        options.format_version = version;
+        CheckDecodedTestFiles(EncodeTestFiles(files, options).data, files);
+    }
+    std::filesystem::remove("decode_table_test");
+    std::cout << "Decode table tests passed" << std::endl;
+}
+
+TEST_CASE("Multi-symbol decode table") {
+    // codes 0, 10, 110, 111 for the symbols a, b, FILENAME_END, d
+    std::vector<Huffman::Symbol> symbols = {'a', 'b', 256, 'd'};
+    std::vector<size_t> length_counts = {0, 1, 1, 2};
+    for (auto order : {BitOrder::MsbFirst, BitOrder::LsbFirst}) {
+        Huffman::DecodeTable table;
+        table.Build(symbols, length_counts, order);
+
+        VectorSink sink;
+        {
+            BitWriter writer(sink, order);
+            writer.WriteBits(0b0'10'0'110'111, 10);
+            writer.Close();
+        }
+        MemorySource source(sink.Data());
+        BitReader reader(source, order);
+        const auto& run = table.LookupRun(reader);
+        REQUIRE(run.count == 2);  // the table is 3 bits wide
+        REQUIRE(run.len == 3);
+        REQUIRE(std::string(run.bytes.data(), run.count) == "ab");
+        reader.Skip(run.len);
+
+        const auto& single = table.LookupRun(reader);
+        REQUIRE(single.count == 1);  // 110 does not fit after 0
+        reader.Skip(single.len);
+        REQUIRE(table.LookupRun(reader).count == 0);  // FILENAME_END stops the run
+        REQUIRE(table.Lookup(reader).symbol == 256);
+    }
+    std::cout << "Multi-symbol decode table tests passed" << std::endl;
+}
+
+TEST_CASE("Canonical decoding from code length counts") {
+    // one code of each length from 1 to 15 and two of length 16: 0, 10, 110, ..., 1111111111111110, 1111111111111111
+    std::vector<Huffman::Symbol> symbols;
+    std::vector<size_t> length_counts(17, 1);
+    length_counts[0] = 0;
+    length_counts[16] = 2;
+    for (size_t i = 0; i < 17; ++i) {
+        symbols.emplace_back(300 + i);
+    }
+    for (auto order : {BitOrder::MsbFirst, BitOrder::LsbFirst}) {
+        Huffman::DecodeTable table;
+        table.Build(symbols, length_counts, order);
+        REQUIRE(table.TableBits() == 11);
+
+        VectorSink sink;
+        {
+            BitWriter writer(sink, order);
+            for (size_t i = 0; i < 17; ++i) {
+                size_t len = std::min<size_t>(i + 1, 16);
+                uint64_t code = i == 16 ? 0xFFFF : ((uint64_t(1) << len) - 1) ^ 1;
+                writer.WriteBits(code, len);
+            }
+            writer.Close();
+        }
+        MemorySource source(sink.Data());
+        BitReader reader(source, order);
+        for (size_t i = 0; i < 17; ++i) {
+            REQUIRE(table.Decode(reader) == Huffman::Symbol(300 + i));
+        }
+        REQUIRE(reader.Status() == ReadStatus::Ok);
+    }
+
+    // 0 and 10 without 11
+    Huffman::DecodeTable table;
+    table.Build({'a', 'b'}, {0, 1, 1}, BitOrder::MsbFirst);
+    std::vector<char> bytes = {'\xC0'};
+    MemorySource source(bytes);
+    BitReader reader(source);
+    REQUIRE_THROWS_AS(table.Decode(reader), std::runtime_error);
+    REQUIRE_THROWS_AS(table.Build({'a'}, std::vector<size_t>(66, 0), BitOrder::MsbFirst), std::runtime_error);
+    std::cout << "Canonical decoding tests passed" << std::endl;
+}
+
+TEST_CASE("Flat Huffman tree") {
+    // a chain of 500 leaves, the deepest two have codes of length 499
+    Huffman::HuffmanTree huffman_tree;
+    auto root = huffman_tree.AddLeaf(0);
+    for (size_t symbol = 1; symbol < 500; ++symbol) {
+        root = huffman_tree.AddInternalNode(huffman_tree.AddLeaf(symbol), root);
+    }
+    auto code_lengths = huffman_tree.GetCodeLengthsForSymbols();
+    REQUIRE(code_lengths.size() == 500);
+    for (const auto& [symbol, len] : code_lengths) {
+        REQUIRE(len == std::min<size_t>(500 - symbol.to_ulong(), 499));
+    }
+
+    std::vector<char> bytes(63, '\xFF');  // 499 ones is the code of the deepest leaf
+    bytes.back() = '\xE0';
+    MemorySource source(bytes);
+    BitReader bin_in(source);
+    REQUIRE(huffman_tree.GetNextSymbol(bin_in) == Huffman::Symbol(0));
+
+    Huffman::HuffmanTree single;
+    single.AddLeaf('x');
+    REQUIRE(single.GetCodeLengthsForSymbols() == std::vector<std::pair<Huffman::Symbol, size_t>>{{'x', 0}});
+    std::cout << "Flat Huffman tree tests passed" << std::endl;
+}
+
+TEST_CASE("Length-limited code lengths") {
+    std::vector<uint64_t> freqs = {32, 1, 16, 2, 4, 8, 1};
+    auto cost = [&](const std::vector<size_t>& lengths) {
+        uint64_t res = 0;
+        for (size_t i = 0; i < freqs.size(); ++i) {
+            res += freqs[i] * lengths[i];
+        }
+        return res;
+    };
+    REQUIRE(Huffman::LimitedCodeLengths(freqs, 64) == std::vector<size_t>{1, 6, 2, 5, 4, 3, 6});
+    auto limited = Huffman::LimitedCodeLengths(freqs, 4);
+    REQUIRE(*std::max_element(limited.begin(), limited.end()) == 4);
+    REQUIRE(cost(limited) == 136);  // found by brute force
+    REQUIRE(Huffman::LimitedCodeLengths(freqs, 3) == std::vector<size_t>{2, 3, 3, 3, 3, 3, 3});
+    REQUIRE_THROWS_AS(Huffman::LimitedCodeLengths(freqs, 2), std::runtime_error);
+
+    // Fibonacci frequencies give codes of 27 bits without the limit
+    std::vector<char> text;
+    size_t prev = 1;
+    size_t freq = 1;
+    for (char c = 'a'; c < 'a' + 25; ++c) {
+        text.insert(text.end(), freq, c);
+        std::tie(prev, freq) = std::make_pair(freq, prev + freq);
+    }
+    std::vector<TestFile> files = {{"limited_test", text}};
+    for (size_t max_code_length : {9, 11, 64}) {
+        Huffman::Options options;
+        options.max_code_length = max_code_length;
+        auto archive = EncodeTestFiles(files, options);
+        REQUIRE(static_cast<size_t>(archive.data[2]) == max_code_length);
+        CheckDecodedTestFiles(archive.data, files);
+    }
+    std::filesystem::remove("limited_test");
+
+    Huffman::Options limit_options;
+    limit_options.max_code_length = 64;
+    auto data = EncodeTestFiles(files, limit_options).data;
+    data[2] = 11;  // the codes are longer than the recorded limit
+    Huffman::Decoder decoder(std::make_unique<MemorySource>(std::move(data)));
+    REQUIRE_THROWS_AS(decoder.Decode(), std::runtime_error);
+
+    Huffman::Options options;
+    options.max_code_length = 8;
+    VectorSink archive;
+    REQUIRE_THROWS_AS(Huffman::Coder(archive, options), std::runtime_error);
+    std::cout << "Length-limited code lengths tests passed" << std::endl;
+}
+
+TEST_CASE("In-place code lengths") {
+    std::mt19937 rnd(15);
+    for (size_t n : {1, 2, 3, 10, 259, 511}) {
+        std::vector<uint64_t> freqs(n);
+        for (auto& freq : freqs) {
+            freq = rnd() % 3 == 0 ? 1 : rnd() % (1 << (rnd() % 20)) + 1;
+        }
+        std::sort(freqs.begin(), freqs.end());
+        auto heap_lengths = Huffman::HeapCodeLengths(freqs);
+        std::vector<uint64_t> lengths = freqs;
+        Huffman::CodeLengthsInPlace(lengths);
+
+        uint64_t heap_cost = 0;
+        uint64_t cost = 0;
+        double kraft_sum = 0;
+        for (size_t i = 0; i < n; ++i) {
+            heap_cost += freqs[i] * heap_lengths[i];
+            cost += freqs[i] * lengths[i];
+            kraft_sum += std::ldexp(1.0, -static_cast<int>(lengths[i]));
+            if (i > 0) {
+                REQUIRE(lengths[i] <= lengths[i - 1]);
+            }
+        }
+        REQUIRE(cost == heap_cost);
+        REQUIRE(kraft_sum == 1.0);
+    }
+    std::cout << "In-place code lengths tests passed" << std::endl;
+}
+
+TEST_CASE("Two-queue code lengths") {
+    std::mt19937_64 rnd(16);
+    Huffman::CodeLengthsBuilder builder;
+    for (size_t n : {0, 1, 2, 5, 259, 511, 65536}) {
+        std::vector<uint64_t> freqs(n);
+        for (auto& freq : freqs) {
+            freq = rnd() % 4 == 0 ? rnd() % 3 : rnd() % (uint64_t(1) << (rnd() % 40));
+        }
+        auto lengths = builder.BuildCodeLengths(freqs);
+        REQUIRE(lengths.size() == n);
+
+        std::vector<uint64_t> sorted = freqs;
+        std::sort(sorted.begin(), sorted.end());
+        std::vector<uint64_t> in_place_lengths = sorted;
+        Huffman::CodeLengthsInPlace(in_place_lengths);
+        uint64_t cost = 0;
+        uint64_t in_place_cost = 0;
+        for (size_t i = 0; i < n; ++i) {
+            cost += freqs[i] * lengths[i];
+            in_place_cost += sorted[i] * in_place_lengths[i];
+        }
+        REQUIRE(cost == in_place_cost);
+        if (n > 1) {
+            std::vector<uint64_t> heap_freqs = freqs;
+            auto heap_lengths = Huffman::HeapCodeLengths(heap_freqs);
+            uint64_t heap_cost = 0;
+            for (size_t i = 0; i < n; ++i) {
+                heap_cost += freqs[i] * heap_lengths[i];
+            }
+            REQUIRE(cost == heap_cost);
+        }
+    }
+    std::vector<uint64_t> freqs = {5, 1, 1, 2};
+    auto lengths = builder.BuildCodeLengths(freqs);
+    REQUIRE(std::vector<size_t>(lengths.begin(), lengths.end()) == std::vector<size_t>{1, 3, 3, 2});
+    std::cout << "Two-queue code lengths tests passed" << std::endl;
+}
+
+TEST_CASE("Aligned bytes") {
+    {
+        VectorSink sink;
+        {
+            BitWriter writer(sink, BitOrder::LsbFirst);
+            writer.Write(0b101, 3);
+            writer.AlignToByte();
+            writer.WriteBytes(std::span<const char>("xyz", 3));
+            writer.Write(0b11, 2);
+            writer.Close();
+        }
+        REQUIRE(sink.Data() == std::vector<char>{'\x05', 'x', 'y', 'z', '\x03'});
+
+        MemorySource source(sink.Data());
+        BitReader reader(source, BitOrder::LsbFirst);
+        REQUIRE(reader.Read(3) == 0b101);
+        reader.AlignToByte();
+        std::array<char, 3> bytes{};
+        reader.ReadBytes(bytes);
+        REQUIRE(std::string(bytes.begin(), bytes.end()) == "xyz");
+        REQUIRE(reader.Read(2) == 0b11);
+    }
+
+    // the streams count byte of the header is always 1
+    std::vector<TestFile> files = {{"streams_test", std::span<const char>("abracadabra", 11)}};
+    auto archive = EncodeTestFiles(files, Huffman::Options{});
+    REQUIRE(archive.data[3] == 1);
+    archive.data[3] = 4;
+    Huffman::Decoder decoder(std::make_unique<MemorySource>(std::move(archive.data)));
+    REQUIRE_THROWS_WITH(decoder.Decode(), "Error: archives with several streams are not supported");
+    std::cout << "Aligned bytes tests passed" << std::endl;
+}
+
+TEST_CASE("Byte histogram") {
+    std::mt19937 rnd(18);
+    std::vector<char> bytes;
+    for (size_t i = 0; i < 100'000; ++i) {
+        bytes.emplace_back(static_cast<char>(i < 50'000 ? rnd() % 256 : 'z'));  // a long run of one byte
+    }
+    ByteHistogram histogram;
+    std::array<uint64_t, ByteHistogram::BYTE_VALUES> expected{};
+    for (size_t pos = 0; pos < bytes.size();) {
+        size_t size = std::min<size_t>(rnd() % 100, bytes.size() - pos);  // parts of any size and alignment
+        histogram.Add(std::span<const char>(bytes).subspan(pos, size));
+        for (size_t i = pos; i < pos + size; ++i) {
+            ++expected[static_cast<unsigned char>(bytes[i])];
+        }
+        pos += size;
+        if (rnd() % 1000 == 0) {
+            REQUIRE(histogram.Counts() == expected);
+        }
+    }
+    REQUIRE(histogram.Counts() == expected);
+    REQUIRE(expected['z'] > 50'000);
+    REQUIRE(ByteHistogram().Counts() == std::array<uint64_t, ByteHistogram::BYTE_VALUES>{});
+    std::cout << "Byte histogram tests passed" << std::endl;
+}
+
+TEST_CASE("Single-read encoding") {
+    class CountingSource : public ByteSource {  // chunks of 1000 bytes, each of them is invalidated by the next one
+    public:
+        explicit CountingSource(const std::vector<char>& data) : data_(data) {
+        }
+        std::span<const char> Next() override {
+            size_t size = std::min<size_t>(data_.size() - pos_, 1000);
+            chunk_.assign(data_.begin() + pos_, data_.begin() + pos_ + size);
+            pos_ += size;
+            bytes_read += size;
+            return chunk_;
+        }
+        bool Rewind() override {
+            pos_ = 0;
+            return true;
+        }
+        size_t bytes_read = 0;
+
+    private:
+        const std::vector<char>& data_;
+        std::vector<char> chunk_;
+        size_t pos_ = 0;
+    };
+
+    std::vector<char> text;
+    std::mt19937 rnd(19);
+    for (size_t i = 0; i < 123'456; ++i) {
+        text.emplace_back(static_cast<char>('a' + rnd() % 13 * rnd() % 5));
+    }
+    for (size_t limit : {size_t(0), text.size() - 1, text.size()}) {
+        CountingSource source(text);
+        std::vector<TestFile> files = {{"single_read_test", text, &source}};
+        Huffman::Options options;
+        options.read_buffer_limit = limit;
+        options.block_size = 0;
+        auto archive = EncodeTestFiles(files, options);
+        REQUIRE(source.bytes_read == (limit < text.size() ? 2 : 1) * text.size());
+        CheckDecodedTestFiles(archive.data, files);
+    }
+    std::filesystem::remove("single_read_test");
+    std::cout << "Single-read encoding tests passed" << std::endl;
+}
+
+size_t heap_allocations = 0;
+
+template <class T>
+struct CountingAllocator {
+    using value_type = T;
+    CountingAllocator() = default;
+    template <class U>
+    explicit CountingAllocator(const CountingAllocator<U>&) {
+    }
+    T* allocate(size_t n) {
+        ++heap_allocations;
+        return std::allocator<T>().allocate(n);
+    }
+    void deallocate(T* p, size_t n) {
+        std::allocator<T>().deallocate(p, n);
+    }
+    bool operator==(const CountingAllocator&) const = default;
+};
+
+TEST_CASE("Pooled leftist heap") {
+    std::mt19937_64 rnd(20);
+    LeftistHeap<uint64_t, std::less<>, CountingAllocator<uint64_t>> heap;
+    size_t max_size = 0;
+    for (size_t n : {0, 1, 2, 7, 1000, 1000, 500}) {
+        std::vector<uint64_t> values(n);
+        for (auto& value : values) {
+            value = rnd() % 100;
+        }
+        size_t allocations = heap_allocations;
+        heap.Assign(values.begin(), values.end());
+        REQUIRE(heap.Size() == n);
+        for (size_t i = 0; i < n; i += 3) {  // the nodes of the extracted values are reused
+            heap.Insert(heap.Extract() + 1);
+            ++*std::min_element(values.begin(), values.end());
+        }
+        std::sort(values.begin(), values.end());
+        std::vector<uint64_t> extracted;
+        while (!heap.Empty()) {
+            extracted.emplace_back(heap.Extract());
+        }
+        REQUIRE(extracted == values);
+        if (n <= max_size) {  // the memory of the previous builds is enough
+            REQUIRE(heap_allocations == allocations);
+        }
+        max_size = std::max(max_size, n);
+    }
+    std::cout << "Pooled leftist heap tests passed" << std::endl;
+}
+
+TEST_CASE("Move-only leftist heap") {
+    auto value_cmp = [](const std::unique_ptr<size_t>& a, const std::unique_ptr<size_t>& b) { return *a < *b; };
+    LeftistHeap<std::unique_ptr<size_t>, decltype(value_cmp)> heap;
+    for (size_t i = 5; i-- > 0;) {
+        heap.Insert(std::make_unique<size_t>(i));
+    }
+    const auto* top = heap.Top().get();
+    REQUIRE(*top == 0);
+    auto lightest = heap.Extract();
+    REQUIRE(lightest.get() == top);  // the value is moved, not copied
+    heap.Emplace(std::move(lightest));
+    REQUIRE(heap.Size() == 5);
+
+    std::vector<std::unique_ptr<size_t>> values;
+    for (size_t i = 0; i < 1000; ++i) {
+        values.emplace_back(std::make_unique<size_t>(i * 7 % 1000));
+    }
+    heap.Assign(std::make_move_iterator(values.begin()), std::make_move_iterator(values.end()));
+    for (size_t i = 0; i < 1000; ++i) {
+        REQUIRE(*heap.Extract() == i);
+    }
+
+    LeftistHeap<size_t, std::greater<>> long_heap;  // long chains of merges without recursion
+    for (size_t i = 0; i < 1'000'000; ++i) {
+        long_heap.Emplace(i);
+    }
+    for (size_t i = 1'000'000; i-- > 0;) {
+        REQUIRE(long_heap.Extract() == i);
+    }
+    std::cout << "Move-only leftist heap tests passed" << std::endl;
+}
+
+struct PointeeLess {
+    bool operator()(const std::unique_ptr<uint64_t>& a, const std::unique_ptr<uint64_t>& b) const {
+        return *a < *b;
+    }
+};
+
+template <class QueuePolicy>
+void CheckQueuePolicy() {
+    std::mt19937_64 rnd(22);
+    typename QueuePolicy::template Queue<uint64_t, std::less<>> queue;
+    for (size_t n : {0, 1, 2, 3, 5, 17, 1000}) {
+        std::vector<uint64_t> values(n);
+        for (auto& value : values) {
+            value = rnd() % 50;
+        }
+        std::multiset<uint64_t> expected(values.begin(), values.end());
+        queue.Assign(values.begin(), values.end());
+        for (size_t i = 0; i < n; i += 2) {
+            REQUIRE(queue.Top() == *expected.begin());
+            uint64_t value = queue.Extract() + rnd() % 10;
+            expected.erase(expected.begin());
+            queue.Insert(value);
+            expected.insert(value);
+        }
+        REQUIRE(queue.Size() == expected.size());
+        for (auto value : expected) {
+            REQUIRE(queue.Extract() == value);
+        }
+        REQUIRE(queue.Empty());
+    }
+
+    using MoveOnlyQueue = typename QueuePolicy::template Queue<std::unique_ptr<uint64_t>, PointeeLess>;
+    static_assert(PriorityQueue<MoveOnlyQueue, std::unique_ptr<uint64_t>>);
+    MoveOnlyQueue pointers;
+    for (uint64_t value : {3, 1, 4, 1, 5}) {
+        pointers.Emplace(std::make_unique<uint64_t>(value));
+    }
+    for (uint64_t value : {1, 1, 3, 4, 5}) {
+        REQUIRE(*pointers.Extract() == value);
+    }
+
+    Huffman::HeapCodeLengthsBuilder<QueuePolicy> builder;
+    Huffman::CodeLengthsBuilder reference;
+    for (size_t n : {2, 259, 65536}) {
+        std::vector<uint64_t> freqs(n);
+        for (auto& freq : freqs) {
+            freq = rnd() % (uint64_t(1) << (rnd() % 30));
+        }
+        auto lengths = builder.BuildCodeLengths(freqs);
+        auto reference_lengths = reference.BuildCodeLengths(freqs);
+        uint64_t cost = 0;
+        uint64_t reference_cost = 0;
+        for (size_t i = 0; i < n; ++i) {
+            cost += freqs[i] * lengths[i];
+            reference_cost += freqs[i] * reference_lengths[i];
+        }
+        REQUIRE(cost == reference_cost);
+    }
+}
+
+TEST_CASE("Priority queue policies") {
+    CheckQueuePolicy<LeftistHeapPolicy>();
+    CheckQueuePolicy<BinaryHeapPolicy>();
+    CheckQueuePolicy<QuaternaryHeapPolicy>();
+    CheckQueuePolicy<PairingHeapPolicy>();
+    std::cout << "Priority queue policies tests passed" << std::endl;
+}
+
+TEST_CASE("Block-parallel compression") {
+    std::mt19937 rnd(23);
+    std::vector<char> text;
+    for (size_t i = 0; i < 3 * Huffman::MIN_BLOCK_SIZE + 1'234; ++i) {
+        // the blocks have different statistics, so that they get different codes
+        size_t alphabet = 3 + i / Huffman::MIN_BLOCK_SIZE * 40;
+        text.emplace_back(static_cast<char>(rnd() % alphabet * rnd() % alphabet));
+    }
+    std::vector<char> same_byte(Huffman::MIN_BLOCK_SIZE + 5, 'q');
+    std::vector<std::span<const char>> files = {std::span<const char>(text).first(0),
+                                                std::span<const char>(text).first(1), same_byte, text};
+    for (auto file : files) {
+        std::vector<char> first_archive;
+        for (size_t threads : {1, 2, 7}) {
+            std::vector<TestFile> test_files = {{"blocks_test", file}};
+            Huffman::Options options;
+            options.block_size = Huffman::MIN_BLOCK_SIZE;
+            options.threads = threads;
+            auto archive = EncodeTestFiles(test_files, options);
+            REQUIRE(archive.data.size() <= (archive.max_bits + 7) / 8);
+            if (first_archive.empty()) {
+                first_archive = archive.data;
+            }
+            REQUIRE(archive.data == first_archive);  // the same for any number of threads
+            CheckDecodedTestFiles(archive.data, test_files);
+        }
+    }
+    std::filesystem::remove("blocks_test");
+
+    for (size_t block_size : {Huffman::MIN_BLOCK_SIZE - 1, Huffman::MAX_BLOCK_SIZE + 1}) {
+        Huffman::Options options;
+        options.block_size = block_size;
+        VectorSink archive;
+        REQUIRE_THROWS(Huffman::Coder(archive, options));
+    }
+    std::cout << "Block-parallel compression tests passed" << std::endl;
+}
+
+TEST_CASE("Concurrent member encoding") {
+    std::mt19937 rnd(24);
+    for (auto order : {BitOrder::MsbFirst, BitOrder::LsbFirst}) {
+        std::vector<char> stream;
+        for (size_t i = 0; i < 50; ++i) {
+            stream.emplace_back(static_cast<char>(rnd()));
+        }
+        for (size_t offset : {0, 3, 8, 13}) {
+            for (uint64_t bits : {0, 5, 64, 77, 400}) {
+                VectorSink spliced;
+                VectorSink expected;
+                {
+                    BitWriter spliced_writer(spliced, order);
+                    BitWriter expected_writer(expected, order);
+                    spliced_writer.WriteBits(0b1011011101111, offset);
+                    expected_writer.WriteBits(0b1011011101111, offset);
+                    spliced_writer.WriteStream(stream, bits);
+                    for (uint64_t bit = 0; bit < bits; ++bit) {
+                        auto byte = static_cast<unsigned char>(stream[bit / 8]);
+                        size_t shift = order == BitOrder::LsbFirst ? bit % 8 : 7 - bit % 8;
+                        expected_writer.Write(byte >> shift, 1);
+                    }
+                    REQUIRE(spliced_writer.PaddingBits() == (8 - (offset + bits) % 8) % 8);
+                }
+                REQUIRE(spliced.Data() == expected.Data());
+            }
+        }
+    }
+
+    std::vector<std::string> files = {"members_test_0", "members_test_1", "members_test_2", "members_test_3",
+                                      "members_test_4"};
+    std::vector<std::vector<char>> texts;
+    for (size_t size : {size_t(0), size_t(1), size_t(1'000), Huffman::MIN_BLOCK_SIZE + 3, size_t(77'777)}) {
+        auto& text = texts.emplace_back();
+        for (size_t i = 0; i < size; ++i) {
+            text.emplace_back(static_cast<char>('a' + rnd() % (texts.size() * 5) * rnd() % 9));
+        }
+    }
+    auto write_files = [&] {
+        for (size_t i = 0; i < files.size(); ++i) {
+            std::ofstream out(files[i], std::ios::binary);
+            out.write(texts[i].data(), static_cast<std::streamsize>(texts[i].size()));
+        }
+    };
+    for (auto version : {Huffman::LEGACY_FORMAT, Huffman::FORMAT_VERSION}) {
+        for (size_t block_size : {size_t(0), Huffman::MIN_BLOCK_SIZE}) {
+            Huffman::Options options;
+            options.format_version = version;
+            options.block_size = block_size;
+            write_files();
+            VectorSink serial;
+            {
+                Huffman::Coder coder(serial, options);
+                for (const auto& file : files) {
+                    coder.AddFile(file);
+                }
+                coder.Close();
+            }
+            for (size_t threads : {1, 3}) {
+                // the files from 1'000 bytes are encoded by AddFile() between the members in buffers
+                for (size_t limit : {size_t(0), size_t(1'000), Huffman::DEFAULT_MEMBER_BUFFER_LIMIT}) {
+                    options.threads = threads;
+                    options.member_buffer_limit = limit;
+                    VectorSink concurrent;
+                    {
+                        Huffman::Coder coder(concurrent, options);
+                        coder.AddFiles(files);
+                        coder.Close();
+                    }
+                    REQUIRE(concurrent.Data() == serial.Data());
+                }
+            }
+            options.io_backend = CreateAsyncIoBackend(4);  // each member gets its own backend
+            VectorSink async_io;
+            {
+                Huffman::Coder coder(async_io, options);
+                coder.AddFiles(files);
+                coder.Close();
+            }
+            REQUIRE(async_io.Data() == serial.Data());
+
+            std::vector<TestFile> test_files;
+            for (size_t i = 0; i < files.size(); ++i) {
+                test_files.push_back({files[i], texts[i]});
+            }
+            CheckDecodedTestFiles(serial.Data(), test_files);
+        }
+    }
+
+    Huffman::Options options;
+    options.threads = 2;
+    VectorSink archive;
+    Huffman::Coder coder(archive, options);
+    REQUIRE_THROWS(coder.AddFiles({files[0], "members_test_missing", files[1], files[2]}));
+    for (const auto& file : files) {
+        std::filesystem::remove(file);
+    }
+    std::cout << "Concurrent member encoding tests passed" << std::endl;
+}
+
+TEST_CASE("Indexed parallel decoding") {
+    {
+        PositionalFile file("positional_test", 10);
+        file.WriteAt(std::span<const char>("6789", 4), 6);
+        file.WriteAt(std::span<const char>("012345", 6), 0);
+        file.Close();
+        std::ifstream in("positional_test", std::ios::binary);
+        REQUIRE(std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>()) == "0123456789");
+    }
+    std::filesystem::remove("positional_test");
+
+    std::mt19937 rnd(25);
+    std::vector<std::vector<char>> texts;
+    for (size_t size : {size_t(1'000), size_t(0), 2 * Huffman::MIN_BLOCK_SIZE, 3 * Huffman::MIN_BLOCK_SIZE + 17,
+                        size_t(1)}) {
+        auto& text = texts.emplace_back();
+        for (size_t i = 0; i < size; ++i) {
+            text.emplace_back(static_cast<char>('a' + rnd() % (texts.size() * 7) * rnd() % 13));
+        }
+    }
+    std::vector<TestFile> files;
+    for (size_t i = 0; i < texts.size(); ++i) {
+        files.push_back({"indexed_test_" + std::to_string(i), texts[i]});
+    }
+    for (size_t block_size : {size_t(0), Huffman::MIN_BLOCK_SIZE}) {
+        Huffman::Options options;
+        options.block_size = block_size;
+        const auto data = EncodeTestFiles(files, options).data;
+        MemorySource offset_source(std::span<const char>(data).last(8));
+        uint64_t index_offset = BitReader(offset_source, BitOrder::LsbFirst).Read(64);
+        MemorySource index_source(std::span<const char>(data).subspan(index_offset));
+        REQUIRE(BitReader(index_source, BitOrder::LsbFirst).Read(64) == texts.size());  // the number of members
+
+        for (size_t threads : {1, 3}) {  // one thread decodes the archive sequentially without the index
+            Huffman::Options decode_options;
+            decode_options.threads = threads;
+            CheckDecodedTestFiles(data, files, decode_options);
+        }
+
+        auto corrupted = data;
+        for (size_t byte = 0; byte < 8; ++byte) {  // the index offset is past the end of the archive
+            corrupted[corrupted.size() - 8 + byte] = static_cast<char>(corrupted.size() >> (8 * byte));
+        }
+        Huffman::Decoder decoder(std::make_unique<MemorySource>(std::move(corrupted)));
+        REQUIRE_THROWS(decoder.Decode());
+    }
+    for (const auto& file : files) {
+        std::filesystem::remove(file.name);
+    }
+
+    // more members than the open files allowed, the file of a member is open only while its blocks are decoded
+    std::vector<TestFile> many_files;
+    for (size_t i = 0; i < 300; ++i) {
+        many_files.push_back({"many_test_" + std::to_string(i), std::span<const char>(texts[0]).first(i)});
+    }
+    auto many_archive = EncodeTestFiles(many_files, {}).data;
+    {
+        struct FilesLimit {
+            rlimit saved{};
+            ~FilesLimit() {
+                setrlimit(RLIMIT_NOFILE, &saved);
+            }
+        } files_limit;
+        REQUIRE(getrlimit(RLIMIT_NOFILE, &files_limit.saved) == 0);
+        rlimit low_limit = files_limit.saved;
+        low_limit.rlim_cur = std::min<rlim_t>(low_limit.rlim_cur, 64);
+        REQUIRE(setrlimit(RLIMIT_NOFILE, &low_limit) == 0);
+        Huffman::Options many_options;
+        many_options.threads = 3;
+        CheckDecodedTestFiles(many_archive, many_files, many_options);
+    }
+    for (const auto& file : many_files) {
+        std::filesystem::remove(file.name);
+    }
+    std::cout << "Indexed parallel decoding tests passed" << std::endl;
+}